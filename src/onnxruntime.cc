@@ -26,10 +26,28 @@
 
 #include <stdint.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <codecvt>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <iomanip>
+#include <locale>
+#include <map>
 #include <mutex>
+#include <optional>
+#include <random>
+#include <set>
+#include <sstream>
+#include <thread>
 #include <vector>
 
 #include "onnxruntime_loader.h"
+#include "onnxruntime_threads.h"
 #include "onnxruntime_utils.h"
 #include "triton/backend/backend_common.h"
 #include "triton/backend/backend_input_collector.h"
@@ -82,8 +100,58 @@ struct BackendConfiguration {
     return RetrieveFrom(model);
   }
 
+  ~BackendConfiguration()
+  {
+    if (load_duration_family_ != nullptr) {
+      LOG_IF_ERROR(
+          TRITONSERVER_MetricFamilyDelete(load_duration_family_),
+          "failed to delete load duration metric family");
+    }
+    if (terminated_run_family_ != nullptr) {
+      LOG_IF_ERROR(
+          TRITONSERVER_MetricFamilyDelete(terminated_run_family_),
+          "failed to delete terminated run metric family");
+    }
+    if (thread_cpu_time_family_ != nullptr) {
+      LOG_IF_ERROR(
+          TRITONSERVER_MetricFamilyDelete(thread_cpu_time_family_),
+          "failed to delete thread CPU time metric family");
+    }
+    if (run_admission_wait_family_ != nullptr) {
+      LOG_IF_ERROR(
+          TRITONSERVER_MetricFamilyDelete(run_admission_wait_family_),
+          "failed to delete run admission wait metric family");
+    }
+    if (run_allocation_family_ != nullptr) {
+      LOG_IF_ERROR(
+          TRITONSERVER_MetricFamilyDelete(run_allocation_family_),
+          "failed to delete run allocation metric family");
+    }
+  }
+
   bool enable_memory_tracker_{false};
   int default_max_batch_size_{0};
+  // Family of the counters of the time spent in each load phase of the
+  // models. nullptr if metrics are not available.
+  TRITONSERVER_MetricFamily* load_duration_family_{nullptr};
+  // Family of the counters of the runs terminated because all their
+  // requests were cancelled. nullptr if metrics are not available.
+  TRITONSERVER_MetricFamily* terminated_run_family_{nullptr};
+  // Family of the counters of the CPU time used by the ONNX Runtime
+  // threads of the models. nullptr if metrics are not available.
+  TRITONSERVER_MetricFamily* thread_cpu_time_family_{nullptr};
+  // Family of the counters of the tensors and buffers allocated by the
+  // executions of the models. nullptr if metrics are not available.
+  TRITONSERVER_MetricFamily* run_allocation_family_{nullptr};
+  // Bound on the total intra-op parallelism of the runs in flight
+  // across the models, nullptr if the runs are not limited. The time
+  // the runs of each model wait for it is counted in the counters of
+  // 'run_admission_wait_family_'.
+  std::unique_ptr<RunAdmission> run_admission_;
+  TRITONSERVER_MetricFamily* run_admission_wait_family_{nullptr};
+  // Directory where optimized models are cached across loads. Empty if
+  // caching is disabled.
+  std::string optimized_model_cache_dir_;
 };
 
 //
@@ -97,7 +165,32 @@ class ModelState : public BackendModel {
  public:
   static TRITONSERVER_Error* Create(
       TRITONBACKEND_Model* triton_model, ModelState** state);
-  virtual ~ModelState() = default;
+  virtual ~ModelState();
+
+  // Settings of the sessions that are specific to the instance using
+  // them.
+  struct InstanceSessionSettings {
+    // Name of the instance, the threads of the sessions are named after.
+    std::string name;
+    // CPU cores the intra-op threads are pinned to, empty if they are
+    // not pinned.
+    std::vector<int> intra_op_cores;
+    // NUMA node the memory of the sessions is allocated on, -1 if any.
+    int numa_node{-1};
+    // Number of intra-op threads of the sessions, 0 to use the one of
+    // the model.
+    int intra_op_thread_count{0};
+  };
+
+  // A session each instance loads in addition to its main session, to
+  // run the batches of up to 'max_batch_size' with 'intra_op_thread_count'
+  // intra-op threads, 0 to use the one of the model, and from the model
+  // file 'artifact_name', empty to use the one of the instance.
+  struct SessionVariant {
+    size_t max_batch_size;
+    int intra_op_thread_count;
+    std::string artifact_name;
+  };
 
   // Load an ONNX model using 'artifact_name' as the name for the ONNX
   // file/directory. If 'instance_group_kind' is not
@@ -105,21 +198,229 @@ class ModelState : public BackendModel {
   // 'instance_group_device_id' to initialize the appropriate
   // execution providers. Return in 'model_path' the full path to the
   // onnx file, return in 'session' and 'allocator' the ORT session
-  // and allocator.
+  // and allocator. The time spent in each phase is added to 'times'.
+  // 'instance_settings' is nullptr if the session is not used by a
+  // single instance.
   TRITONSERVER_Error* LoadModel(
       const std::string& artifact_name,
       const TRITONSERVER_InstanceGroupKind instance_group_kind,
       const int32_t instance_group_device_id, std::string* model_path,
       OrtSession** session, OrtAllocator** default_allocator,
-      cudaStream_t stream);
+      cudaStream_t stream, LoadPhaseTimes* times,
+      const InstanceSessionSettings* instance_settings = nullptr);
+
+  // Return in 'session' the ORT session that is shared by all the
+  // instances using 'artifact_name' with 'instance_group_kind' on
+  // 'instance_group_device_id'. The session is loaded with LoadModel()
+  // by the first instance that asks for it and is released once no
+  // instance references it, for example because all the instances
+  // hibernated (see SessionIdleTimeoutSec()).
+  TRITONSERVER_Error* LoadSharedModel(
+      const std::string& artifact_name,
+      const TRITONSERVER_InstanceGroupKind instance_group_kind,
+      const int32_t instance_group_device_id, std::string* model_path,
+      std::shared_ptr<OrtSession>* session, OrtAllocator** default_allocator,
+      LoadPhaseTimes* times);
+
+  // Log 'times' as a single line of 'key=value' pairs prefixed by 'source'
+  // and add them to the load duration metrics of the model.
+  void ReportLoadPhaseTimes(
+      const std::string& source, const LoadPhaseTimes& times);
+
+  // Inputs and outputs of a model file as read from a session, and
+  // whether an instance validated them against the model configuration.
+  // Once validated, 'input_infos' also holds the overridable
+  // initializers.
+  struct SessionIO {
+    std::set<std::string> input_names;
+    OnnxTensorInfoMap input_infos;
+    std::set<std::string> overridable_initializer_names;
+    OnnxTensorInfoMap overridable_initializer_infos;
+    std::set<std::string> output_names;
+    OnnxTensorInfoMap output_infos;
+    bool validated{false};
+    std::unordered_map<std::string, std::vector<int64_t>> scalar_outputs;
+  };
+
+  // Return in 'io' the inputs and outputs of the model loaded from
+  // 'artifact_name'. They are read from 'session' the first time they
+  // are requested for 'artifact_name' and cached for the other sessions.
+  TRITONSERVER_Error* SessionIOFor(
+      const std::string& artifact_name, OrtSession* session,
+      OrtAllocator* allocator, SessionIO* io);
+
+  // Record that the inputs and outputs of 'artifact_name' are valid for
+  // the model configuration, along with the inputs merged with the
+  // overridable initializers and the scalar outputs found while
+  // validating, so that the next instances can skip the validation.
+  void SetSessionIOValidated(
+      const std::string& artifact_name, const OnnxTensorInfoMap& input_infos,
+      const std::unordered_map<std::string, std::vector<int64_t>>&
+          scalar_outputs);
 
   const std::map<std::string, std::pair<int64_t, int64_t>>& ModelOutputs()
   {
     return model_outputs_;
   }
 
+  // Whether instances on the same device share a single session.
+  bool ShareSessionBetweenInstances() const
+  {
+    return share_session_between_instances_;
+  }
+
+  // Return in 'cores' the CPU cores the intra-op threads of
+  // 'triton_model_instance' are pinned to, empty if they are not pinned,
+  // and in 'numa_node' the NUMA node the memory of its sessions is
+  // allocated on, -1 if any. Each call takes the next configured core
+  // set.
+  TRITONSERVER_Error* IntraOpCoresFor(
+      TRITONBACKEND_ModelInstance* triton_model_instance,
+      std::vector<int>* cores, int* numa_node);
+
+  // Number of seconds an instance can stay idle before its session is
+  // released, 0 if the session is never released.
+  int SessionIdleTimeoutSec() const { return session_idle_timeout_sec_; }
+
+  // The session variants of the instances, by increasing maximum batch
+  // size. A batch runs on the first variant it fits in, or on the main
+  // session if it fits in none.
+  const std::vector<SessionVariant>& SessionVariants() const
+  {
+    return session_variants_;
+  }
+
+  // Whether the model is run with ORT RunAsync so that an instance can
+  // accept the next requests while the previous ones are running, and
+  // the maximum number of executions in flight on an instance.
+  bool EnableAsyncRun() const { return enable_async_run_; }
+  int MaxInflightExecutions() const { return max_inflight_executions_; }
+
+  // Whether the instances overlap gathering the inputs, running the
+  // model and scattering the outputs of consecutive executions, with up
+  // to MaxInflightExecutions() executions in flight.
+  bool EnablePipelinedExecution() const { return enable_pipelined_execution_; }
+
+  // Whether the runs whose requests are all cancelled are terminated,
+  // and the interval at which the requests of the runs are checked.
+  bool EnableRunTermination() const { return enable_run_termination_; }
+  int RunTerminationCheckIntervalMs() const
+  {
+    return run_termination_check_interval_ms_;
+  }
+  // Count a terminated run in the metrics of the model.
+  void ReportTerminatedRun();
+  // Add 'cnt' tensors and buffers allocated by an execution to the
+  // metrics of the model.
+  void ReportRunAllocations(const uint64_t cnt);
+
+  // Add the CPU time used by the ONNX Runtime threads of the model since
+  // the last report to the metrics of the model.
+  void ReportThreadCpuTime();
+
+  // Number of intra-op threads a run of an instance whose intra-op
+  // threads are pinned to 'pinned_core_cnt' cores may use, counted
+  // against the run-admission-capacity backend limit. A positive
+  // 'intra_op_thread_count' overrides the one of the model.
+  size_t RunAdmissionWeight(
+      const size_t pinned_core_cnt, const int intra_op_thread_count = 0) const;
+  // Wait for a run of 'weight' threads to be admitted by the
+  // run-admission-capacity backend limit, then release it once the run
+  // completes. No-op if the runs are not limited or 'weight' is 0.
+  void AdmitRun(const size_t weight);
+  void EndAdmittedRun(const size_t weight);
+
+  // Number of threads of each instance running executions concurrently
+  // on the session of the instance, each with its own IO binding. 0 if
+  // the executions are run by the thread executing the requests.
+  int RunWorkerCount() const { return run_worker_count_; }
+
+  // Maximum batch size of a single run, the requests of a larger batch
+  // are run in sub-batches. 0 if only limited by the maximum batch size.
+  size_t ExecutionBatchSize() const { return execution_batch_size_; }
+
+  // Map of output name -> shape, without the batch dimension, of the
+  // outputs whose shape is known before the run, so that the model can
+  // write them into buffers bound ahead of the run.
+  const std::unordered_map<std::string, std::vector<int64_t>>&
+  StaticOutputDims() const
+  {
+    return static_output_dims_;
+  }
+  // Whether the outputs of 'StaticOutputDims()' are written directly
+  // into the response buffer of a single-request batch.
+  bool EnableZeroCopyOutput() const { return enable_zero_copy_output_; }
+
+  // Padding of the variable-size dimension of some inputs up to the
+  // next of the ascending ShapeBuckets() so that the session sees a few
+  // stable shapes. ShapeBucketInputs() and ShapeBucketOutputs() map the
+  // padded inputs and the outputs trimmed back to the real size to the
+  // index of that dimension in their batched shape. The padding is
+  // filled with ShapeBucketPadValue() and, if not empty,
+  // ShapeBucketMaskInput() is an input generated with 1 for the real
+  // elements and 0 for the padding.
+  const std::vector<int64_t>& ShapeBuckets() const { return shape_buckets_; }
+  const std::unordered_map<std::string, size_t>& ShapeBucketInputs() const
+  {
+    return shape_bucket_inputs_;
+  }
+  const std::unordered_map<std::string, size_t>& ShapeBucketOutputs() const
+  {
+    return shape_bucket_outputs_;
+  }
+  double ShapeBucketPadValue() const { return shape_bucket_pad_value_; }
+  const std::string& ShapeBucketMaskInput() const
+  {
+    return shape_bucket_mask_input_;
+  }
+  // Return the smallest bucket that 'size' fits in, or 'size' if it is
+  // larger than all the buckets.
+  int64_t ShapeBucketFor(const int64_t size) const;
+
+  // Whether each instance is warmed up before it is ready, and the batch
+  // sizes and values of the dynamic dimensions used for the warmup.
+  bool EnableInstanceWarmup() const { return enable_instance_warmup_; }
+  const std::vector<int64_t>& WarmupBatchSizes() const
+  {
+    return warmup_batch_sizes_;
+  }
+  const std::vector<int64_t>& WarmupDimValues() const
+  {
+    return warmup_dim_values_;
+  }
+
  private:
   ModelState(TRITONBACKEND_Model* triton_model);
+  // Return in 'model_path' the full path to the onnx file described by
+  // 'artifact_name'.
+  TRITONSERVER_Error* ModelPath(
+      const std::string& artifact_name, std::string* model_path);
+  // Return in 'cache_path' the path of the cached optimized model for
+  // the model at 'model_path' when loaded with the current model
+  // configuration on 'instance_group_kind' and 'instance_group_device_id'.
+  // The file name is a hash of everything that affects the optimized
+  // graph so a stale entry is never picked up.
+  TRITONSERVER_Error* OptimizedModelCachePath(
+      const std::string& model_path,
+      const TRITONSERVER_InstanceGroupKind instance_group_kind,
+      const int32_t instance_group_device_id, std::string* cache_path);
+  // Return in 'file' the memory mapping of the file at 'path', mapping
+  // the file if the file now at 'path' isn't mapped yet.
+  TRITONSERVER_Error* MapModelFile(
+      const std::string& path, const MappedFile** file);
+  // Register the custom op libraries of the model configuration on
+  // 'soptions'.
+  TRITONSERVER_Error* RegisterCustomOpLibraries(OrtSessionOptions* soptions);
+  // Load a session of 'artifact_name' that is only used to read the
+  // inputs and outputs of the model, without graph optimizations nor
+  // execution providers.
+  TRITONSERVER_Error* LoadMetadataSession(
+      const std::string& artifact_name, std::string* model_path,
+      OrtSession** session, OrtAllocator** default_allocator,
+      LoadPhaseTimes* times);
+  // Find the index of the variable-size dimension of the inputs and the
+  // outputs that are bucketed in the model configuration.
+  TRITONSERVER_Error* ResolveShapeBucketDims();
   TRITONSERVER_Error* AutoCompleteConfig();
   TRITONSERVER_Error* AutoCompleteMaxBatch(
       const OnnxTensorInfoMap& input_tensor_infos,
@@ -130,6 +431,173 @@ class ModelState : public BackendModel {
   // Session options used when creating a ORT session.
   std::unique_ptr<OrtSessionOptions, SessionOptionsDeleter> session_options_;
 
+  // If true a single session is created for each distinct artifact,
+  // instance kind and device and that session is used by all the
+  // instances matching it. Each instance still owns its IO binding and
+  // run options.
+  bool share_session_between_instances_;
+
+  // Number of intra-op threads of a session, 0 if ORT picks it. The
+  // intra-op threads of each instance are pinned to the CPU cores of the
+  // host policy of the instance if 'intra_op_affinity_from_host_policy_',
+  // otherwise to the next set of 'intra_op_core_sets_', if any.
+  int intra_op_thread_count_;
+  bool intra_op_affinity_from_host_policy_;
+  std::vector<std::vector<int>> intra_op_core_sets_;
+  std::atomic<size_t> next_intra_op_core_set_;
+
+  std::vector<SessionVariant> session_variants_;
+
+  // Directory used to cache the optimized model, empty if the optimized
+  // model is not cached.
+  std::string optimized_model_cache_dir_;
+  // Content hash of each model file, by path, along with the size and
+  // modification time of the file it was computed for, so that the
+  // file is only read again once it changes.
+  std::mutex model_file_hashes_mu_;
+  std::map<std::string, std::pair<std::string, uint64_t>> model_file_hashes_;
+
+  // If true the model file is memory-mapped and the session is created
+  // from the mapping instead of from the path. The mappings are kept for
+  // the lifetime of the model as sessions created from an ORT format
+  // model use the mapped bytes directly, so they must be declared
+  // before anything holding sessions. They are keyed by the identity of
+  // the file rather than its path, so that a file replaced at the same
+  // path, such as a rebuilt optimized model cache entry, is mapped
+  // again.
+  bool enable_model_mmap_;
+  std::mutex mapped_files_mu_;
+  std::map<std::string, std::unique_ptr<MappedFile>> mapped_files_;
+
+  // Return the metric of the model in 'family', labeled with the name
+  // and version of the model. nullptr if 'family' is nullptr or the
+  // metric can't be created.
+  TRITONSERVER_Metric* NewModelMetric(
+      TRITONSERVER_MetricFamily* family, const char* description);
+
+  // Return the hooks creating the ONNX Runtime threads named 'name',
+  // pinned to 'cores' if not nullptr. The hooks of a name are created
+  // by its first call.
+  OrtThreadHooks* ThreadHooksFor(
+      const std::string& name, const std::vector<int>* cores = nullptr);
+
+  // Return the container of the weights prepacked for the sessions on
+  // 'numa_node', -1 if the sessions are not on a specific node. nullptr
+  // if sharing is disabled.
+  OrtPrepackedWeightsContainer* PrepackedWeightsContainerFor(
+      const int numa_node);
+
+  // Containers for the weights prepacked by the CPU kernels, shared by
+  // all the sessions of the model on the same NUMA node so that each
+  // weight is prepacked once per node regardless of the instance count.
+  // Empty if 'share_prepacked_weights_' is false. Must outlive the
+  // sessions using them.
+  bool share_prepacked_weights_;
+  std::mutex prepacked_weights_mu_;
+  std::map<
+      int, std::unique_ptr<
+               OrtPrepackedWeightsContainer, PrepackedWeightsContainerDeleter>>
+      prepacked_weights_containers_;
+
+  // If true each instance runs the model on synthetic inputs for every
+  // combination of 'warmup_batch_sizes_' and 'warmup_dim_values_' before
+  // it is ready, so that the first requests don't pay for growing the
+  // arena and for the lazy initialization of the kernels.
+  bool enable_instance_warmup_;
+  std::vector<int64_t> warmup_batch_sizes_;
+  std::vector<int64_t> warmup_dim_values_;
+
+  // Number of seconds after which the session of an idle instance is
+  // released, 0 to keep the sessions for the lifetime of the instances.
+  int session_idle_timeout_sec_;
+
+  // If true the instances return from the execution once the model is
+  // running and send the responses from the completion callback, with
+  // at most 'max_inflight_executions_' executions in flight per instance.
+  bool enable_async_run_;
+  int max_inflight_executions_;
+
+  // If true the instances run the model and send the responses from
+  // their own threads so that the inputs of the next execution are
+  // gathered while the model runs.
+  bool enable_pipelined_execution_;
+
+  // If positive the instances return once the inputs are gathered and
+  // 'run_worker_count_' threads per instance run the model and send the
+  // responses.
+  int run_worker_count_;
+
+  // Maximum batch size of a single run, 0 for no limit other than the
+  // maximum batch size.
+  int execution_batch_size_;
+
+  // If true a run is terminated once all its requests are cancelled,
+  // which is checked every 'run_termination_check_interval_ms_'. The
+  // terminated runs are counted by 'terminated_run_metric_', nullptr if
+  // metrics are not available.
+  bool enable_run_termination_;
+  int run_termination_check_interval_ms_;
+  TRITONSERVER_Metric* terminated_run_metric_;
+
+  // Counts the tensors and buffers allocated by the executions, nullptr
+  // if metrics are not available.
+  TRITONSERVER_Metric* run_allocation_metric_;
+
+  // Backend limit on the intra-op threads of the runs in flight, nullptr
+  // if the runs are not limited. The runs of the model count for
+  // 'run_admission_weight_' threads, derived from the intra-op threads of
+  // the sessions if 0, and are admitted before the runs of lower
+  // 'run_admission_priority_'. The time they wait is added to
+  // 'run_admission_wait_metric_', nullptr if metrics are not available.
+  RunAdmission* run_admission_;
+  int run_admission_weight_;
+  int run_admission_priority_;
+  TRITONSERVER_Metric* run_admission_wait_metric_;
+
+  // If true the threads of the sessions are created by the hooks of
+  // 'thread_hooks_', keyed by the instance they belong to or by the
+  // model for the sessions shared by the instances, and reniced to
+  // 'ort_thread_nice_' if not 0. Their CPU time is added to
+  // 'thread_cpu_time_metric_', nullptr if metrics are not available.
+  // The hooks must outlive the sessions.
+  bool enable_ort_thread_hooks_;
+  int ort_thread_nice_;
+  std::mutex thread_hooks_mu_;
+  std::map<std::string, std::unique_ptr<OrtThreadHooks>> thread_hooks_;
+  TRITONSERVER_Metric* thread_cpu_time_metric_;
+  uint64_t reported_thread_cpu_time_us_;
+  std::chrono::steady_clock::time_point last_thread_cpu_time_report_;
+
+  // If true the outputs in 'static_output_dims_' are bound to the
+  // response buffers when possible instead of being copied into them.
+  bool enable_zero_copy_output_;
+  std::unordered_map<std::string, std::vector<int64_t>> static_output_dims_;
+
+  // Shape bucketing, empty 'shape_buckets_' if disabled. The dimension
+  // indices are resolved once the model configuration is complete.
+  std::vector<int64_t> shape_buckets_;
+  std::unordered_map<std::string, size_t> shape_bucket_inputs_;
+  std::unordered_map<std::string, size_t> shape_bucket_outputs_;
+  double shape_bucket_pad_value_;
+  std::string shape_bucket_mask_input_;
+
+  // Sessions shared across instances, keyed by artifact name, instance
+  // kind and device id. The sessions are owned by the instances using
+  // them. 'shared_sessions_mu_' also serializes the loading of a shared
+  // session so it is only created once.
+  std::mutex shared_sessions_mu_;
+  std::map<std::string, std::weak_ptr<OrtSession>> shared_sessions_;
+
+  // Inputs and outputs of the model, keyed by artifact name. Filled by
+  // the auto-complete or by the first instance loading the artifact.
+  std::mutex session_ios_mu_;
+  std::map<std::string, SessionIO> session_ios_;
+
+  // Load duration counters of the model, keyed by load phase. Created
+  // the first time a phase is reported.
+  std::mutex load_duration_metrics_mu_;
+  std::map<std::string, TRITONSERVER_Metric*> load_duration_metrics_;
+
   // model_outputs is a map that contains unique outputs that the model must
   // provide. In the model configuration, the output in the state configuration
   // can have intersection with the outputs section of the model. If an output
@@ -159,6 +627,7 @@ ModelState::Create(TRITONBACKEND_Model* triton_model, ModelState** state)
     RETURN_IF_ERROR((*state)->AutoCompleteConfig());
     RETURN_IF_ERROR((*state)->SetModelConfig());
   }
+  RETURN_IF_ERROR((*state)->ResolveShapeBucketDims());
 
   auto& model_outputs = (*state)->model_outputs_;
 
@@ -199,6 +668,26 @@ ModelState::Create(TRITONBACKEND_Model* triton_model, ModelState** state)
     } else {
       it->second.first = i;
     }
+
+    // The shape of the output must be known before the run for the
+    // model to write it into a buffer bound ahead of the run. Outputs
+    // that are also states, batch outputs and reshaped outputs are
+    // allocated by ORT.
+    triton::common::TritonJson::Value reshape;
+    if ((it == model_outputs.end()) &&
+        ((*state)->FindBatchOutput(output_name_str) == nullptr) &&
+        !output.Find("reshape", &reshape)) {
+      std::string data_type;
+      std::vector<int64_t> dims;
+      RETURN_IF_ERROR(output.MemberAsString("data_type", &data_type));
+      RETURN_IF_ERROR(ParseShape(output, "dims", &dims));
+      if ((data_type != "TYPE_STRING") &&
+          std::none_of(dims.begin(), dims.end(), [](const int64_t dim) {
+            return dim < 0;
+          })) {
+        (*state)->static_output_dims_.emplace(output_name_str, dims);
+      }
+    }
   }
 
 
@@ -206,7 +695,21 @@ ModelState::Create(TRITONBACKEND_Model* triton_model, ModelState** state)
 }
 
 ModelState::ModelState(TRITONBACKEND_Model* triton_model)
-    : BackendModel(triton_model, true /* allow_optional */)
+    : BackendModel(triton_model, true /* allow_optional */),
+      share_session_between_instances_(false), intra_op_thread_count_(0),
+      intra_op_affinity_from_host_policy_(false), next_intra_op_core_set_(0),
+      enable_model_mmap_(false), share_prepacked_weights_(false),
+      enable_instance_warmup_(false), session_idle_timeout_sec_(0),
+      enable_async_run_(false), max_inflight_executions_(2),
+      enable_pipelined_execution_(false), run_worker_count_(0),
+      execution_batch_size_(0), enable_run_termination_(false),
+      run_termination_check_interval_ms_(10), terminated_run_metric_(nullptr),
+      run_allocation_metric_(nullptr), run_admission_(nullptr),
+      run_admission_weight_(0), run_admission_priority_(0),
+      run_admission_wait_metric_(nullptr), enable_ort_thread_hooks_(false),
+      ort_thread_nice_(0), thread_cpu_time_metric_(nullptr),
+      reported_thread_cpu_time_us_(0), enable_zero_copy_output_(false),
+      shape_bucket_pad_value_(0)
 {
   // Create session options that will be cloned and used for each
   // instance when creating that instance's session.
@@ -273,15 +776,14 @@ ModelState::ModelState(TRITONBACKEND_Model* triton_model)
     {
       // Sets the number of threads used to parallelize the execution within
       // nodes A value of 0 means ORT will pick a default
-      int intra_op_thread_count = 0;
       triton::common::TritonJson::Value params;
       if (ModelConfig().Find("parameters", &params)) {
         THROW_IF_BACKEND_MODEL_ERROR(TryParseModelStringParameter(
-            params, "intra_op_thread_count", &intra_op_thread_count, 0));
+            params, "intra_op_thread_count", &intra_op_thread_count_, 0));
       }
-      if (intra_op_thread_count > 0) {
+      if (intra_op_thread_count_ > 0) {
         THROW_IF_BACKEND_MODEL_ORT_ERROR(
-            ort_api->SetIntraOpNumThreads(soptions, intra_op_thread_count));
+            ort_api->SetIntraOpNumThreads(soptions, intra_op_thread_count_));
       }
     }
 
@@ -302,6 +804,12 @@ ModelState::ModelState(TRITONBACKEND_Model* triton_model)
     }
   }
 
+  // use the CPU arena shared through the environment, if registered
+  if (OnnxLoader::IsSharedCpuArenaEnabled()) {
+    THROW_IF_BACKEND_MODEL_ORT_ERROR(ort_api->AddSessionConfigEntry(
+        soptions, "session.use_env_allocators", "1"));
+  }
+
   // memory configs
   // enable/disable mem arena
   {
@@ -359,124 +867,1194 @@ ModelState::ModelState(TRITONBACKEND_Model* triton_model)
     }
   }
 
-  // FIXME. Is it possible to share a single OrtSession across
-  // multiple instances? If so then should move loading and validation
-  // of the session to here instead of creating a session for each
-  // instance in ModelStateInstance::Create().
-}
+  // share a single session across the instances
+  {
+    triton::common::TritonJson::Value params;
+    if (ModelConfig().Find("parameters", &params)) {
+      THROW_IF_BACKEND_MODEL_ERROR(TryParseModelStringParameter(
+          params, "share_session_between_instances",
+          &share_session_between_instances_, false));
+    }
+    LOG_MESSAGE(
+        TRITONSERVER_LOG_VERBOSE,
+        (std::string("Configuring share_session_between_instances to ") +
+         (share_session_between_instances_ ? "true" : "false"))
+            .c_str());
+  }
 
-TRITONSERVER_Error*
-ModelState::LoadModel(
-    const std::string& artifact_name,
-    const TRITONSERVER_InstanceGroupKind instance_group_kind,
-    const int32_t instance_group_device_id, std::string* model_path,
-    OrtSession** session, OrtAllocator** default_allocator, cudaStream_t stream)
-{
-  // Find the ONNX file that describes the model itself. If the model
-  // configuration doesn't have an explicit model file specified then
-  // use the default name ("model.onnx").
-  std::string cc_model_filename = artifact_name;
-  if (cc_model_filename.empty()) {
-    cc_model_filename = "model.onnx";
+  // pin the intra-op threads of each instance to its own CPU cores
+  {
+    std::string affinity;
+    triton::common::TritonJson::Value params;
+    if (ModelConfig().Find("parameters", &params)) {
+      THROW_IF_BACKEND_MODEL_ERROR(TryParseModelStringParameter(
+          params, "intra_op_thread_affinity", &affinity, ""));
+    }
+    if (affinity == "host_policy") {
+      intra_op_affinity_from_host_policy_ = true;
+    } else if (!affinity.empty() && (affinity != "none")) {
+      std::stringstream ss(affinity);
+      std::string core_list;
+      while (std::getline(ss, core_list, ';')) {
+        intra_op_core_sets_.emplace_back();
+        THROW_IF_BACKEND_MODEL_ERROR(
+            ParseCpuCoreList(core_list, &intra_op_core_sets_.back()));
+      }
+    }
+    const bool pinned =
+        intra_op_affinity_from_host_policy_ || !intra_op_core_sets_.empty();
+    if (pinned && (OnnxLoader::IsGlobalThreadPoolEnabled() ||
+                   share_session_between_instances_)) {
+      throw BackendModelException(TRITONSERVER_ErrorNew(
+          TRITONSERVER_ERROR_INVALID_ARG,
+          (std::string("Invalid intra_op_thread_affinity value '") +
+           affinity + "' for '" + Name() +
+           "', the intra-op threads can't be pinned per instance with the "
+           "global thread pool or with share_session_between_instances")
+              .c_str()));
+    }
+    if (pinned) {
+      LOG_MESSAGE(
+          TRITONSERVER_LOG_VERBOSE,
+          (std::string("Configuring intra_op_thread_affinity to ") + affinity)
+              .c_str());
+    }
   }
 
-  *model_path = JoinPath(
-      {RepositoryPath(), std::to_string(Version()), cc_model_filename});
+  // load variants of the session of each instance for ranges of batch
+  // sizes
+  {
+    std::string variants;
+    triton::common::TritonJson::Value params;
+    if (ModelConfig().Find("parameters", &params)) {
+      THROW_IF_BACKEND_MODEL_ERROR(TryParseModelStringParameter(
+          params, "session_variants", &variants, ""));
+    }
+    std::stringstream ss(variants);
+    std::string variant;
+    while (std::getline(ss, variant, ';')) {
+      if (variant.empty()) {
+        continue;
+      }
+      std::vector<std::string> fields;
+      std::stringstream vss(variant);
+      std::string field;
+      while (std::getline(vss, field, ':')) {
+        fields.push_back(field);
+      }
+      int max_batch_size = 0;
+      int thread_cnt = -1;
+      if ((fields.size() == 2) || (fields.size() == 3)) {
+        TRITONSERVER_Error* err = ParseIntValue(fields[0], &max_batch_size);
+        if (err == nullptr) {
+          err = ParseIntValue(fields[1], &thread_cnt);
+        }
+        if (err != nullptr) {
+          TRITONSERVER_ErrorDelete(err);
+          max_batch_size = 0;
+        }
+      }
+      if ((max_batch_size <= 0) || (thread_cnt < 0)) {
+        throw BackendModelException(TRITONSERVER_ErrorNew(
+            TRITONSERVER_ERROR_INVALID_ARG,
+            (std::string("Invalid session_variants entry '") + variant +
+             "' for '" + Name() +
+             "', expected <max batch size>:<intra-op thread count>[:<model "
+             "file>]")
+                .c_str()));
+      }
+      for (const auto& other : session_variants_) {
+        if (other.max_batch_size == (size_t)max_batch_size) {
+          throw BackendModelException(TRITONSERVER_ErrorNew(
+              TRITONSERVER_ERROR_INVALID_ARG,
+              (std::string("Invalid session_variants value '") + variants +
+               "' for '" + Name() + "', maximum batch size " +
+               std::to_string(max_batch_size) + " is given more than once")
+                  .c_str()));
+        }
+      }
+      session_variants_.push_back(SessionVariant{
+          (size_t)max_batch_size, thread_cnt,
+          (fields.size() == 3) ? fields[2] : ""});
+      if ((thread_cnt > 0) && OnnxLoader::IsGlobalThreadPoolEnabled()) {
+        throw BackendModelException(TRITONSERVER_ErrorNew(
+            TRITONSERVER_ERROR_INVALID_ARG,
+            (std::string("Invalid session_variants value '") + variants +
+             "' for '" + Name() +
+             "', the intra-op thread count can't be set per session with "
+             "the global thread pool")
+                .c_str()));
+      }
+    }
+    if (!session_variants_.empty() && share_session_between_instances_) {
+      throw BackendModelException(TRITONSERVER_ErrorNew(
+          TRITONSERVER_ERROR_INVALID_ARG,
+          (std::string("Invalid session_variants value '") + variants +
+           "' for '" + Name() +
+           "', session variants can't be used with "
+           "share_session_between_instances")
+              .c_str()));
+    }
+    std::sort(
+        session_variants_.begin(), session_variants_.end(),
+        [](const SessionVariant& a, const SessionVariant& b) {
+          return a.max_batch_size < b.max_batch_size;
+        });
+    if (!session_variants_.empty()) {
+      LOG_MESSAGE(
+          TRITONSERVER_LOG_VERBOSE,
+          (std::string("Configuring session_variants to ") + variants)
+              .c_str());
+    }
+  }
 
-  // If the model path is a directory then the actual model is
-  // <dir>/model.onnx.
+  // cache the optimized model if the backend is configured with a cache
+  // directory, unless the model opts out
   {
-    bool is_dir;
-    RETURN_IF_ERROR(IsDirectory(*model_path, &is_dir));
-    if (is_dir) {
-      *model_path = JoinPath({*model_path, "model.onnx"});
+    bool enable_optimized_model_cache = true;
+    triton::common::TritonJson::Value params;
+    if (ModelConfig().Find("parameters", &params)) {
+      THROW_IF_BACKEND_MODEL_ERROR(TryParseModelStringParameter(
+          params, "enable_optimized_model_cache",
+          &enable_optimized_model_cache, true));
+    }
+    if (enable_optimized_model_cache) {
+      optimized_model_cache_dir_ =
+          BackendConfiguration::RetrieveFrom(triton_model)
+              .optimized_model_cache_dir_;
+    }
+    if (!optimized_model_cache_dir_.empty()) {
+      LOG_MESSAGE(
+          TRITONSERVER_LOG_VERBOSE,
+          (std::string("Caching optimized model of '") + Name() + "' in " +
+           optimized_model_cache_dir_)
+              .c_str());
     }
   }
 
+  // create sessions from a memory mapping of the model file
   {
-    bool exists;
-    RETURN_IF_ERROR(FileExists(*model_path, &exists));
-    RETURN_ERROR_IF_FALSE(
-        exists, TRITONSERVER_ERROR_UNAVAILABLE,
-        std::string("unable to find '") + *model_path +
-            "' for model instance '" + Name() + "'");
+    triton::common::TritonJson::Value params;
+    if (ModelConfig().Find("parameters", &params)) {
+      THROW_IF_BACKEND_MODEL_ERROR(TryParseModelStringParameter(
+          params, "enable_model_mmap", &enable_model_mmap_, false));
+    }
+    LOG_MESSAGE(
+        TRITONSERVER_LOG_VERBOSE,
+        (std::string("Configuring enable_model_mmap to ") +
+         (enable_model_mmap_ ? "true" : "false"))
+            .c_str());
   }
 
-  // Make a clone for the session options for this instance...
-  OrtSessionOptions* soptions;
-  RETURN_IF_ORT_ERROR(
-      ort_api->CloneSessionOptions(session_options_.get(), &soptions));
-  std::unique_ptr<OrtSessionOptions, SessionOptionsDeleter> soptions_wrapper(
-      soptions);
+  // share prepacked weights between the sessions of the model
+  {
+    triton::common::TritonJson::Value params;
+    if (ModelConfig().Find("parameters", &params)) {
+      THROW_IF_BACKEND_MODEL_ERROR(TryParseModelStringParameter(
+          params, "share_prepacked_weights", &share_prepacked_weights_,
+          false));
+    }
+    LOG_MESSAGE(
+        TRITONSERVER_LOG_VERBOSE,
+        (std::string("Configuring share_prepacked_weights to ") +
+         (share_prepacked_weights_ ? "true" : "false"))
+            .c_str());
+  }
 
-  bool need_lock = false;
+  // warm up the instances with synthetic inputs before they are ready
+  {
+    std::string batch_sizes, dim_values;
+    triton::common::TritonJson::Value params;
+    if (ModelConfig().Find("parameters", &params)) {
+      THROW_IF_BACKEND_MODEL_ERROR(TryParseModelStringParameter(
+          params, "enable_instance_warmup", &enable_instance_warmup_, false));
+      THROW_IF_BACKEND_MODEL_ERROR(TryParseModelStringParameter(
+          params, "instance_warmup_batch_sizes", &batch_sizes, ""));
+      THROW_IF_BACKEND_MODEL_ERROR(TryParseModelStringParameter(
+          params, "instance_warmup_dim_values", &dim_values, ""));
+    }
+    if (enable_instance_warmup_) {
+      // By default warm up with the smallest and the largest batch, and
+      // with 1 for the dynamic dimensions.
+      if (batch_sizes.empty()) {
+        warmup_batch_sizes_.push_back(1);
+        if (MaxBatchSize() > 1) {
+          warmup_batch_sizes_.push_back(MaxBatchSize());
+        }
+      } else {
+        THROW_IF_BACKEND_MODEL_ERROR(
+            ParseIntListValue(batch_sizes, &warmup_batch_sizes_));
+      }
+      if (dim_values.empty()) {
+        warmup_dim_values_.push_back(1);
+      } else {
+        THROW_IF_BACKEND_MODEL_ERROR(
+            ParseIntListValue(dim_values, &warmup_dim_values_));
+      }
 
-  // Add execution providers if they are requested.
-  // Don't need to ensure uniqueness of the providers, ONNX Runtime
-  // will check it.
+      for (const int64_t batch_size : warmup_batch_sizes_) {
+        if ((batch_size < 1) ||
+            ((MaxBatchSize() > 0) && (batch_size > MaxBatchSize()))) {
+          throw BackendModelException(TRITONSERVER_ErrorNew(
+              TRITONSERVER_ERROR_INVALID_ARG,
+              (std::string("Invalid instance_warmup_batch_sizes value ") +
+               std::to_string(batch_size) + " for '" + Name() +
+               "', expected a value between 1 and max_batch_size")
+                  .c_str()));
+        }
+      }
+      for (const int64_t dim_value : warmup_dim_values_) {
+        if (dim_value < 1) {
+          throw BackendModelException(TRITONSERVER_ErrorNew(
+              TRITONSERVER_ERROR_INVALID_ARG,
+              (std::string("Invalid instance_warmup_dim_values value ") +
+               std::to_string(dim_value) + " for '" + Name() +
+               "', expected a positive value")
+                  .c_str()));
+        }
+      }
+    }
+    LOG_MESSAGE(
+        TRITONSERVER_LOG_VERBOSE,
+        (std::string("Configuring enable_instance_warmup to ") +
+         (enable_instance_warmup_ ? "true" : "false"))
+            .c_str());
+  }
 
-  // GPU execution providers
-#ifdef TRITON_ENABLE_GPU
-  if ((instance_group_kind == TRITONSERVER_INSTANCEGROUPKIND_GPU) ||
-      (instance_group_kind == TRITONSERVER_INSTANCEGROUPKIND_AUTO)) {
-    std::map<std::string, std::string> cuda_options_map;
-    triton::common::TritonJson::Value optimization;
-    if (model_config_.Find("optimization", &optimization)) {
-      triton::common::TritonJson::Value eas;
-      if (optimization.Find("execution_accelerators", &eas)) {
-        triton::common::TritonJson::Value gpu_eas;
-        if (eas.Find("gpu_execution_accelerator", &gpu_eas)) {
-          for (size_t ea_idx = 0; ea_idx < gpu_eas.ArraySize(); ea_idx++) {
-            triton::common::TritonJson::Value ea;
-            RETURN_IF_ERROR(gpu_eas.IndexAsObject(ea_idx, &ea));
-            std::string name;
-            RETURN_IF_ERROR(ea.MemberAsString("name", &name));
-#ifdef TRITON_ENABLE_ONNXRUNTIME_TENSORRT
-            if (name == kTensorRTExecutionAccelerator) {
-              // create tensorrt options with default values
-              OrtTensorRTProviderOptionsV2* trt_options;
-              THROW_IF_BACKEND_MODEL_ORT_ERROR(
-                  ort_api->CreateTensorRTProviderOptions(&trt_options));
-              std::unique_ptr<
-                  OrtTensorRTProviderOptionsV2,
-                  decltype(ort_api->ReleaseTensorRTProviderOptions)>
-                  rel_trt_options(
-                      trt_options, ort_api->ReleaseTensorRTProviderOptions);
-              std::string int8_calibration_table_name;
-              std::string trt_engine_cache_path;
-              // Validate and set parameters
-              triton::common::TritonJson::Value params;
-              if (ea.Find("parameters", &params)) {
-                std::vector<std::string> param_keys, keys, values;
-                RETURN_IF_ERROR(params.Members(&param_keys));
-                for (const auto& param_key : param_keys) {
-                  std::string value_string, key, value;
-                  if (param_key == "precision_mode") {
-                    RETURN_IF_ERROR(params.MemberAsString(
-                        param_key.c_str(), &value_string));
-                    if (value_string == "FP16") {
-                      key = "trt_fp16_enable";
-                      value = "1";
-                    } else if (value_string == "INT8") {
-                      key = "trt_int8_enable";
-                      value = "1";
-                    } else if (value_string != "FP32") {
-                      RETURN_ERROR_IF_FALSE(
-                          false, TRITONSERVER_ERROR_INVALID_ARG,
-                          std::string("unsupported precision mode '") +
-                              value_string + "' is requested");
-                    }
-                  } else if (param_key == "max_workspace_size_bytes") {
-                    RETURN_IF_ERROR(params.MemberAsString(
-                        param_key.c_str(), &value_string));
-                    size_t max_workspace_size_bytes;
-                    RETURN_IF_ERROR(ParseUnsignedLongLongValue(
-                        value_string, &max_workspace_size_bytes));
-                    key = "trt_max_workspace_size";
-                    value = value_string;
-                  } else if (param_key == "trt_max_partition_iterations") {
-                    RETURN_IF_ERROR(params.MemberAsString(
-                        param_key.c_str(), &value_string));
+  // release the sessions of idle instances
+  {
+    triton::common::TritonJson::Value params;
+    if (ModelConfig().Find("parameters", &params)) {
+      THROW_IF_BACKEND_MODEL_ERROR(TryParseModelStringParameter(
+          params, "session_idle_timeout_sec", &session_idle_timeout_sec_, 0));
+    }
+    if (session_idle_timeout_sec_ < 0) {
+      throw BackendModelException(TRITONSERVER_ErrorNew(
+          TRITONSERVER_ERROR_INVALID_ARG,
+          (std::string("Invalid session_idle_timeout_sec value ") +
+           std::to_string(session_idle_timeout_sec_) + " for '" + Name() +
+           "', expected a non-negative integer")
+              .c_str()));
+    }
+    LOG_MESSAGE(
+        TRITONSERVER_LOG_VERBOSE,
+        (std::string("Configuring session_idle_timeout_sec to ") +
+         std::to_string(session_idle_timeout_sec_))
+            .c_str());
+  }
+
+  // run the model asynchronously or pipeline the executions
+  {
+    triton::common::TritonJson::Value params;
+    if (ModelConfig().Find("parameters", &params)) {
+      THROW_IF_BACKEND_MODEL_ERROR(TryParseModelStringParameter(
+          params, "enable_async_run", &enable_async_run_, false));
+      THROW_IF_BACKEND_MODEL_ERROR(TryParseModelStringParameter(
+          params, "enable_pipelined_execution", &enable_pipelined_execution_,
+          false));
+      THROW_IF_BACKEND_MODEL_ERROR(TryParseModelStringParameter(
+          params, "max_inflight_executions", &max_inflight_executions_, 2));
+      THROW_IF_BACKEND_MODEL_ERROR(TryParseModelStringParameter(
+          params, "run_worker_count", &run_worker_count_, 0));
+    }
+    if ((enable_async_run_ + enable_pipelined_execution_ +
+         (run_worker_count_ > 0)) > 1) {
+      throw BackendModelException(TRITONSERVER_ErrorNew(
+          TRITONSERVER_ERROR_INVALID_ARG,
+          (std::string("only one of enable_async_run, "
+                       "enable_pipelined_execution and run_worker_count "
+                       "can be enabled for '") +
+           Name() + "'")
+              .c_str()));
+    }
+    if (run_worker_count_ < 0) {
+      throw BackendModelException(TRITONSERVER_ErrorNew(
+          TRITONSERVER_ERROR_INVALID_ARG,
+          (std::string("Invalid run_worker_count value ") +
+           std::to_string(run_worker_count_) + " for '" + Name() +
+           "', expected a non-negative integer")
+              .c_str()));
+    }
+    // The executions of a batching model use more cores by batching more
+    // requests, run workers are for the models that can't.
+    if ((run_worker_count_ > 0) && (MaxBatchSize() > 0)) {
+      throw BackendModelException(TRITONSERVER_ErrorNew(
+          TRITONSERVER_ERROR_INVALID_ARG,
+          (std::string("run_worker_count is not supported for '") + Name() +
+           "' as it supports batching, expected max_batch_size 0")
+              .c_str()));
+    }
+    if (enable_async_run_ && OnnxLoader::IsGlobalThreadPoolEnabled() &&
+        (OnnxLoader::GlobalIntraOpThreadCount() == 1)) {
+      throw BackendModelException(TRITONSERVER_ErrorNew(
+          TRITONSERVER_ERROR_INVALID_ARG,
+          (std::string("enable_async_run is not supported for '") + Name() +
+           "' as the global intra-op thread pool has a single thread, ORT "
+           "requires at least 2")
+              .c_str()));
+    }
+    if (max_inflight_executions_ < 1) {
+      throw BackendModelException(TRITONSERVER_ErrorNew(
+          TRITONSERVER_ERROR_INVALID_ARG,
+          (std::string("Invalid max_inflight_executions value ") +
+           std::to_string(max_inflight_executions_) + " for '" + Name() +
+           "', expected a positive integer")
+              .c_str()));
+    }
+    // The implicit state of a sequence is updated when its execution
+    // completes, so the next execution of the sequence must not start
+    // before that.
+    triton::common::TritonJson::Value sequence_batching, states;
+    if ((enable_async_run_ || enable_pipelined_execution_ ||
+         (run_worker_count_ > 0)) &&
+        ModelConfig().Find("sequence_batching", &sequence_batching) &&
+        sequence_batching.Find("state", &states) && (states.ArraySize() > 0)) {
+      throw BackendModelException(TRITONSERVER_ErrorNew(
+          TRITONSERVER_ERROR_INVALID_ARG,
+          (std::string(
+               enable_async_run_
+                   ? "enable_async_run"
+                   : (enable_pipelined_execution_ ? "enable_pipelined_execution"
+                                                  : "run_worker_count")) +
+           " is not supported for '" + Name() + "' as it uses implicit state")
+              .c_str()));
+    }
+    LOG_MESSAGE(
+        TRITONSERVER_LOG_VERBOSE,
+        (std::string("Configuring enable_async_run to ") +
+         (enable_async_run_ ? "true" : "false") +
+         ", enable_pipelined_execution to " +
+         (enable_pipelined_execution_ ? "true" : "false") +
+         ", max_inflight_executions to " +
+         std::to_string(max_inflight_executions_) + ", run_worker_count to " +
+         std::to_string(run_worker_count_))
+            .c_str());
+  }
+
+  // terminate the runs of cancelled requests
+  {
+    triton::common::TritonJson::Value params;
+    if (ModelConfig().Find("parameters", &params)) {
+      THROW_IF_BACKEND_MODEL_ERROR(TryParseModelStringParameter(
+          params, "enable_run_termination", &enable_run_termination_, false));
+      THROW_IF_BACKEND_MODEL_ERROR(TryParseModelStringParameter(
+          params, "run_termination_check_interval_ms",
+          &run_termination_check_interval_ms_, 10));
+    }
+    if (run_termination_check_interval_ms_ < 1) {
+      throw BackendModelException(TRITONSERVER_ErrorNew(
+          TRITONSERVER_ERROR_INVALID_ARG,
+          (std::string("Invalid run_termination_check_interval_ms value ") +
+           std::to_string(run_termination_check_interval_ms_) + " for '" +
+           Name() + "', expected a positive integer")
+              .c_str()));
+    }
+    if (enable_run_termination_) {
+      terminated_run_metric_ = NewModelMetric(
+          BackendConfiguration::RetrieveFrom(TritonModel())
+              .terminated_run_family_,
+          "terminated run");
+    }
+    LOG_MESSAGE(
+        TRITONSERVER_LOG_VERBOSE,
+        (std::string("Configuring enable_run_termination to ") +
+         (enable_run_termination_ ? "true" : "false") +
+         ", run_termination_check_interval_ms to " +
+         std::to_string(run_termination_check_interval_ms_))
+            .c_str());
+  }
+
+  // count the tensors and buffers allocated by the executions
+  run_allocation_metric_ = NewModelMetric(
+      BackendConfiguration::RetrieveFrom(TritonModel()).run_allocation_family_,
+      "run allocation");
+
+  // limit the intra-op threads of the runs in flight across the models
+  {
+    triton::common::TritonJson::Value params;
+    if (ModelConfig().Find("parameters", &params)) {
+      THROW_IF_BACKEND_MODEL_ERROR(TryParseModelStringParameter(
+          params, "run_admission_weight", &run_admission_weight_, 0));
+      THROW_IF_BACKEND_MODEL_ERROR(TryParseModelStringParameter(
+          params, "run_admission_priority", &run_admission_priority_, 0));
+    }
+    if (run_admission_weight_ < 0) {
+      throw BackendModelException(TRITONSERVER_ErrorNew(
+          TRITONSERVER_ERROR_INVALID_ARG,
+          (std::string("Invalid run_admission_weight value ") +
+           std::to_string(run_admission_weight_) + " for '" + Name() +
+           "', expected a non-negative integer")
+              .c_str()));
+    }
+    const BackendConfiguration& backend_config =
+        BackendConfiguration::RetrieveFrom(TritonModel());
+    run_admission_ = backend_config.run_admission_.get();
+    if (run_admission_ != nullptr) {
+      run_admission_wait_metric_ = NewModelMetric(
+          backend_config.run_admission_wait_family_, "run admission wait");
+      LOG_MESSAGE(
+          TRITONSERVER_LOG_VERBOSE,
+          (std::string("Configuring run_admission_weight to ") +
+           std::to_string(run_admission_weight_) +
+           ", run_admission_priority to " +
+           std::to_string(run_admission_priority_))
+              .c_str());
+    }
+  }
+
+  // create the ONNX Runtime threads of the sessions with the backend
+  // hooks
+  {
+    triton::common::TritonJson::Value params;
+    if (ModelConfig().Find("parameters", &params)) {
+      THROW_IF_BACKEND_MODEL_ERROR(TryParseModelStringParameter(
+          params, "enable_ort_thread_hooks", &enable_ort_thread_hooks_,
+          false));
+      THROW_IF_BACKEND_MODEL_ERROR(TryParseModelStringParameter(
+          params, "ort_thread_nice", &ort_thread_nice_, 0));
+    }
+    if ((ort_thread_nice_ < -20) || (ort_thread_nice_ > 19)) {
+      throw BackendModelException(TRITONSERVER_ErrorNew(
+          TRITONSERVER_ERROR_INVALID_ARG,
+          (std::string("Invalid ort_thread_nice value ") +
+           std::to_string(ort_thread_nice_) + " for '" + Name() +
+           "', expected a value between -20 and 19")
+              .c_str()));
+    }
+    enable_ort_thread_hooks_ |= (ort_thread_nice_ != 0);
+    if (enable_ort_thread_hooks_) {
+      thread_cpu_time_metric_ = NewModelMetric(
+          BackendConfiguration::RetrieveFrom(TritonModel())
+              .thread_cpu_time_family_,
+          "thread CPU time");
+    }
+    LOG_MESSAGE(
+        TRITONSERVER_LOG_VERBOSE,
+        (std::string("Configuring enable_ort_thread_hooks to ") +
+         (enable_ort_thread_hooks_ ? "true" : "false") +
+         ", ort_thread_nice to " + std::to_string(ort_thread_nice_))
+            .c_str());
+  }
+
+  // run large batches in sub-batches
+  {
+    triton::common::TritonJson::Value params;
+    if (ModelConfig().Find("parameters", &params)) {
+      THROW_IF_BACKEND_MODEL_ERROR(TryParseModelStringParameter(
+          params, "execution_batch_size", &execution_batch_size_, 0));
+    }
+    if (execution_batch_size_ < 0) {
+      throw BackendModelException(TRITONSERVER_ErrorNew(
+          TRITONSERVER_ERROR_INVALID_ARG,
+          (std::string("Invalid execution_batch_size value ") +
+           std::to_string(execution_batch_size_) + " for '" + Name() +
+           "', expected a non-negative integer")
+              .c_str()));
+    }
+    LOG_MESSAGE(
+        TRITONSERVER_LOG_VERBOSE,
+        (std::string("Configuring execution_batch_size to ") +
+         std::to_string(execution_batch_size_))
+            .c_str());
+  }
+
+  // write the outputs directly into the response buffers
+  {
+    triton::common::TritonJson::Value params;
+    if (ModelConfig().Find("parameters", &params)) {
+      THROW_IF_BACKEND_MODEL_ERROR(TryParseModelStringParameter(
+          params, "enable_zero_copy_output", &enable_zero_copy_output_,
+          false));
+    }
+    LOG_MESSAGE(
+        TRITONSERVER_LOG_VERBOSE,
+        (std::string("Configuring enable_zero_copy_output to ") +
+         (enable_zero_copy_output_ ? "true" : "false"))
+            .c_str());
+  }
+
+  // pad variable-size inputs up to a few bucket sizes
+  {
+    std::string buckets, inputs, outputs, pad_value;
+    triton::common::TritonJson::Value params;
+    if (ModelConfig().Find("parameters", &params)) {
+      THROW_IF_BACKEND_MODEL_ERROR(
+          TryParseModelStringParameter(params, "shape_buckets", &buckets, ""));
+      THROW_IF_BACKEND_MODEL_ERROR(TryParseModelStringParameter(
+          params, "shape_bucket_inputs", &inputs, ""));
+      THROW_IF_BACKEND_MODEL_ERROR(TryParseModelStringParameter(
+          params, "shape_bucket_outputs", &outputs, ""));
+      THROW_IF_BACKEND_MODEL_ERROR(TryParseModelStringParameter(
+          params, "shape_bucket_pad_value", &pad_value, ""));
+      THROW_IF_BACKEND_MODEL_ERROR(TryParseModelStringParameter(
+          params, "shape_bucket_mask_input", &shape_bucket_mask_input_, ""));
+    }
+    if (!buckets.empty()) {
+      THROW_IF_BACKEND_MODEL_ERROR(ParseIntListValue(buckets, &shape_buckets_));
+      for (size_t idx = 0; idx < shape_buckets_.size(); idx++) {
+        if ((shape_buckets_[idx] < 1) ||
+            ((idx > 0) && (shape_buckets_[idx] <= shape_buckets_[idx - 1]))) {
+          throw BackendModelException(TRITONSERVER_ErrorNew(
+              TRITONSERVER_ERROR_INVALID_ARG,
+              (std::string("Invalid shape_buckets value '") + buckets +
+               "' for '" + Name() +
+               "', expected positive integers in ascending order")
+                  .c_str()));
+        }
+      }
+      std::vector<std::string> names;
+      ParseStringListValue(inputs, &names);
+      for (const auto& name : names) {
+        shape_bucket_inputs_.emplace(name, 0);
+      }
+      ParseStringListValue(outputs, &names);
+      for (const auto& name : names) {
+        shape_bucket_outputs_.emplace(name, 0);
+      }
+      if (shape_bucket_inputs_.empty()) {
+        throw BackendModelException(TRITONSERVER_ErrorNew(
+            TRITONSERVER_ERROR_INVALID_ARG,
+            (std::string("shape_bucket_inputs must be set for '") + Name() +
+             "' when shape_buckets is set")
+                .c_str()));
+      }
+      if (!pad_value.empty()) {
+        THROW_IF_BACKEND_MODEL_ERROR(
+            ParseDoubleValue(pad_value, &shape_bucket_pad_value_));
+      }
+    }
+    LOG_MESSAGE(
+        TRITONSERVER_LOG_VERBOSE,
+        (std::string("Configuring shape_buckets to '") + buckets +
+         "', shape_bucket_inputs to '" + inputs +
+         "', shape_bucket_outputs to '" + outputs +
+         "', shape_bucket_mask_input to '" + shape_bucket_mask_input_ + "'")
+            .c_str());
+  }
+}
+
+int64_t
+ModelState::ShapeBucketFor(const int64_t size) const
+{
+  auto it =
+      std::lower_bound(shape_buckets_.begin(), shape_buckets_.end(), size);
+  return (it == shape_buckets_.end()) ? size : *it;
+}
+
+TRITONSERVER_Error*
+ModelState::ResolveShapeBucketDims()
+{
+  if (shape_buckets_.empty()) {
+    return nullptr;  // success
+  }
+
+  const size_t batch_dim_cnt = (MaxBatchSize() > 0) ? 1 : 0;
+  for (const char* key : {"input", "output"}) {
+    auto& bucketed = (std::string(key) == "input") ? shape_bucket_inputs_
+                                                   : shape_bucket_outputs_;
+    std::set<std::string> resolved;
+    triton::common::TritonJson::Value ios;
+    RETURN_IF_ERROR(ModelConfig().MemberAsArray(key, &ios));
+    for (size_t i = 0; i < ios.ArraySize(); i++) {
+      triton::common::TritonJson::Value io;
+      RETURN_IF_ERROR(ios.IndexAsObject(i, &io));
+      std::string io_name;
+      RETURN_IF_ERROR(io.MemberAsString("name", &io_name));
+      if (io_name == shape_bucket_mask_input_) {
+        return TRITONSERVER_ErrorNew(
+            TRITONSERVER_ERROR_INVALID_ARG,
+            (std::string("shape_bucket_mask_input '") + io_name +
+             "' of '" + Name() +
+             "' is generated and must not be in the model configuration")
+                .c_str());
+      }
+      auto it = bucketed.find(io_name);
+      if (it == bucketed.end()) {
+        continue;
+      }
+
+      std::string io_dtype;
+      RETURN_IF_ERROR(io.MemberAsString("data_type", &io_dtype));
+      std::vector<int64_t> dims;
+      triton::common::TritonJson::Value reshape;
+      if (io.Find("reshape", &reshape)) {
+        RETURN_IF_ERROR(ParseShape(reshape, "shape", &dims));
+      } else {
+        RETURN_IF_ERROR(ParseShape(io, "dims", &dims));
+      }
+      auto dim_it = std::find(dims.begin(), dims.end(), -1);
+      if ((io_dtype == "TYPE_STRING") || (dim_it == dims.end()) ||
+          IsInputRagged(io_name)) {
+        return TRITONSERVER_ErrorNew(
+            TRITONSERVER_ERROR_INVALID_ARG,
+            (std::string("unable to bucket ") + key + " '" + io_name +
+             "' of '" + Name() +
+             "', expected a non-string, non-ragged tensor with a "
+             "variable-size dimension")
+                .c_str());
+      }
+      it->second = batch_dim_cnt + (dim_it - dims.begin());
+      resolved.insert(io_name);
+    }
+    for (const auto& io : bucketed) {
+      if (resolved.count(io.first) == 0) {
+        return TRITONSERVER_ErrorNew(
+            TRITONSERVER_ERROR_INVALID_ARG,
+            (std::string("unable to bucket ") + key + " '" + io.first +
+             "' of '" + Name() + "', not found in the model configuration")
+                .c_str());
+      }
+    }
+  }
+
+  return nullptr;  // success
+}
+
+TRITONSERVER_Metric*
+ModelState::NewModelMetric(
+    TRITONSERVER_MetricFamily* family, const char* description)
+{
+  if (family == nullptr) {
+    return nullptr;
+  }
+
+  const std::string version = std::to_string(Version());
+  std::vector<TRITONSERVER_Parameter*> labels{
+      TRITONSERVER_ParameterNew(
+          "model", TRITONSERVER_PARAMETER_STRING, Name().c_str()),
+      TRITONSERVER_ParameterNew(
+          "version", TRITONSERVER_PARAMETER_STRING, version.c_str())};
+  TRITONSERVER_Metric* metric = nullptr;
+  TRITONSERVER_Error* err = TRITONSERVER_MetricNew(
+      &metric, family,
+      const_cast<const TRITONSERVER_Parameter**>(labels.data()),
+      labels.size());
+  for (TRITONSERVER_Parameter* label : labels) {
+    TRITONSERVER_ParameterDelete(label);
+  }
+  if (err != nullptr) {
+    LOG_IF_ERROR(
+        err, (std::string("failed to create ") + description + " metric")
+                 .c_str());
+    return nullptr;
+  }
+  return metric;
+}
+
+OrtThreadHooks*
+ModelState::ThreadHooksFor(
+    const std::string& name, const std::vector<int>* cores)
+{
+  std::lock_guard<std::mutex> lk(thread_hooks_mu_);
+  auto& hooks = thread_hooks_[name];
+  if (hooks == nullptr) {
+    hooks.reset(new OrtThreadHooks(
+        name, ort_thread_nice_,
+        (cores != nullptr) ? *cores : std::vector<int>()));
+  }
+  return hooks.get();
+}
+
+void
+ModelState::ReportThreadCpuTime()
+{
+  // Reading the CPU time of a thread is a system call, so the metric is
+  // refreshed at most once per second.
+  static constexpr std::chrono::seconds kReportInterval(1);
+  if (thread_cpu_time_metric_ == nullptr) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lk(thread_hooks_mu_);
+  const auto now = std::chrono::steady_clock::now();
+  if (now - last_thread_cpu_time_report_ < kReportInterval) {
+    return;
+  }
+  last_thread_cpu_time_report_ = now;
+  uint64_t cpu_time_us = 0;
+  for (auto& hooks : thread_hooks_) {
+    cpu_time_us += hooks.second->CpuTimeNs() / 1000;
+  }
+  if (cpu_time_us > reported_thread_cpu_time_us_) {
+    LOG_IF_ERROR(
+        TRITONSERVER_MetricIncrement(
+            thread_cpu_time_metric_,
+            cpu_time_us - reported_thread_cpu_time_us_),
+        "failed to increment thread CPU time metric");
+    reported_thread_cpu_time_us_ = cpu_time_us;
+  }
+}
+
+size_t
+ModelState::RunAdmissionWeight(
+    const size_t pinned_core_cnt, const int intra_op_thread_count) const
+{
+  if (run_admission_weight_ > 0) {
+    return run_admission_weight_;
+  }
+  if (intra_op_thread_count > 0) {
+    return intra_op_thread_count;
+  }
+  if (intra_op_thread_count_ > 0) {
+    return intra_op_thread_count_;
+  }
+  if (pinned_core_cnt > 0) {
+    return pinned_core_cnt;
+  }
+  // ORT uses as many intra-op threads as there are cores.
+  return std::max(1U, std::thread::hardware_concurrency());
+}
+
+void
+ModelState::AdmitRun(const size_t weight)
+{
+  if ((run_admission_ == nullptr) || (weight == 0)) {
+    return;
+  }
+
+  const uint64_t wait_ns =
+      run_admission_->Acquire(weight, run_admission_priority_);
+  if ((wait_ns > 0) && (run_admission_wait_metric_ != nullptr)) {
+    LOG_IF_ERROR(
+        TRITONSERVER_MetricIncrement(
+            run_admission_wait_metric_, wait_ns / 1000.0),
+        "failed to increment run admission wait metric");
+  }
+}
+
+void
+ModelState::EndAdmittedRun(const size_t weight)
+{
+  if ((run_admission_ != nullptr) && (weight > 0)) {
+    run_admission_->Release(weight);
+  }
+}
+
+TRITONSERVER_Error*
+ModelState::IntraOpCoresFor(
+    TRITONBACKEND_ModelInstance* triton_model_instance,
+    std::vector<int>* cores, int* numa_node)
+{
+  cores->clear();
+  *numa_node = -1;
+  if (!intra_op_core_sets_.empty()) {
+    *cores = intra_op_core_sets_
+        [next_intra_op_core_set_++ % intra_op_core_sets_.size()];
+    return nullptr;  // success
+  }
+  if (!intra_op_affinity_from_host_policy_) {
+    return nullptr;  // success
+  }
+
+  // The host policy is a single '{"<name>": {<setting>: <value>}}'
+  // object, the instance is pinned only if the policy sets its cores or
+  // its NUMA node, in which case it is pinned to the cores of the node
+  // unless the cores are also set.
+  TRITONSERVER_Message* host_policy_message;
+  RETURN_IF_ERROR(TRITONBACKEND_ModelInstanceHostPolicy(
+      triton_model_instance, &host_policy_message));
+  const char* buffer;
+  size_t byte_size;
+  RETURN_IF_ERROR(TRITONSERVER_MessageSerializeToJson(
+      host_policy_message, &buffer, &byte_size));
+  triton::common::TritonJson::Value host_policy;
+  RETURN_IF_ERROR(host_policy.Parse(buffer, byte_size));
+  std::vector<std::string> policy_names;
+  RETURN_IF_ERROR(host_policy.Members(&policy_names));
+  for (const auto& policy_name : policy_names) {
+    triton::common::TritonJson::Value settings;
+    if (!host_policy.Find(policy_name.c_str(), &settings)) {
+      continue;
+    }
+    triton::common::TritonJson::Value value;
+    if (settings.Find("numa-node", &value)) {
+      std::string node;
+      RETURN_IF_ERROR(value.AsString(&node));
+      RETURN_IF_ERROR(ParseIntValue(node, numa_node));
+    }
+    if (settings.Find("cpu-cores", &value)) {
+      std::string core_list;
+      RETURN_IF_ERROR(value.AsString(&core_list));
+      RETURN_IF_ERROR(ParseCpuCoreList(core_list, cores));
+    } else if (*numa_node >= 0) {
+      RETURN_IF_ERROR(NumaNodeCpuCores(*numa_node, cores));
+    }
+  }
+
+  return nullptr;  // success
+}
+
+OrtPrepackedWeightsContainer*
+ModelState::PrepackedWeightsContainerFor(const int numa_node)
+{
+  if (!share_prepacked_weights_) {
+    return nullptr;
+  }
+
+  std::lock_guard<std::mutex> lk(prepacked_weights_mu_);
+  auto& container = prepacked_weights_containers_[numa_node];
+  if (container == nullptr) {
+    OrtPrepackedWeightsContainer* created = nullptr;
+    OrtStatus* status = ort_api->CreatePrepackedWeightsContainer(&created);
+    if (status != nullptr) {
+      LOG_MESSAGE(
+          TRITONSERVER_LOG_WARN,
+          (std::string("unable to share prepacked weights for '") + Name() +
+           "': " + ort_api->GetErrorMessage(status))
+              .c_str());
+      ort_api->ReleaseStatus(status);
+      return nullptr;
+    }
+    container.reset(created);
+  }
+  return container.get();
+}
+
+ModelState::~ModelState()
+{
+  if (run_admission_wait_metric_ != nullptr) {
+    LOG_IF_ERROR(
+        TRITONSERVER_MetricDelete(run_admission_wait_metric_),
+        "failed to delete run admission wait metric");
+  }
+  if (thread_cpu_time_metric_ != nullptr) {
+    LOG_IF_ERROR(
+        TRITONSERVER_MetricDelete(thread_cpu_time_metric_),
+        "failed to delete thread CPU time metric");
+  }
+  if (terminated_run_metric_ != nullptr) {
+    LOG_IF_ERROR(
+        TRITONSERVER_MetricDelete(terminated_run_metric_),
+        "failed to delete terminated run metric");
+  }
+  if (run_allocation_metric_ != nullptr) {
+    LOG_IF_ERROR(
+        TRITONSERVER_MetricDelete(run_allocation_metric_),
+        "failed to delete run allocation metric");
+  }
+  for (auto& metric : load_duration_metrics_) {
+    LOG_IF_ERROR(
+        TRITONSERVER_MetricDelete(metric.second),
+        "failed to delete load duration metric");
+  }
+}
+
+TRITONSERVER_Error*
+ModelState::ModelPath(const std::string& artifact_name, std::string* model_path)
+{
+  // Find the ONNX file that describes the model itself. If the model
+  // configuration doesn't have an explicit model file specified then
+  // use the default name ("model.onnx").
+  std::string cc_model_filename = artifact_name;
+  if (cc_model_filename.empty()) {
+    cc_model_filename = "model.onnx";
+  }
+
+  *model_path = JoinPath(
+      {RepositoryPath(), std::to_string(Version()), cc_model_filename});
+
+  // If the model path is a directory then the actual model is
+  // <dir>/model.onnx.
+  {
+    bool is_dir;
+    RETURN_IF_ERROR(IsDirectory(*model_path, &is_dir));
+    if (is_dir) {
+      *model_path = JoinPath({*model_path, "model.onnx"});
+    }
+  }
+
+  return nullptr;  // success
+}
+
+TRITONSERVER_Error*
+ModelState::OptimizedModelCachePath(
+    const std::string& model_path,
+    const TRITONSERVER_InstanceGroupKind instance_group_kind,
+    const int32_t instance_group_device_id, std::string* cache_path)
+{
+  uint64_t hash = kHashOffsetBasis;
+  {
+    std::error_code ec;
+    const auto size = std::filesystem::file_size(model_path, ec);
+    const auto mtime = std::filesystem::last_write_time(model_path, ec)
+                           .time_since_epoch()
+                           .count();
+    const std::string stamp =
+        std::to_string(size) + ":" + std::to_string(mtime);
+    std::lock_guard<std::mutex> lk(model_file_hashes_mu_);
+    auto it = model_file_hashes_.find(model_path);
+    if (ec || (it == model_file_hashes_.end()) ||
+        (it->second.first != stamp)) {
+      RETURN_IF_ERROR(HashFile(model_path, &hash));
+      model_file_hashes_[model_path] = std::make_pair(stamp, hash);
+    } else {
+      hash = it->second.second;
+    }
+  }
+
+  // External data lives next to the model file. Hashing the content of
+  // those files on every load would cost as much as reading the weights
+  // twice so only their name, size and modification time are used.
+  std::string settings;
+  {
+    namespace fs = std::filesystem;
+    const fs::path model_file(model_path);
+    std::error_code ec;
+    std::vector<std::string> entries;
+    for (const auto& entry :
+         fs::directory_iterator(model_file.parent_path(), ec)) {
+      if ((entry.path() == model_file) || !entry.is_regular_file(ec)) {
+        continue;
+      }
+      const auto size = entry.file_size(ec);
+      const auto mtime = entry.last_write_time(ec).time_since_epoch().count();
+      entries.emplace_back(
+          entry.path().filename().string() + ":" + std::to_string(size) +
+          ":" + std::to_string(mtime));
+    }
+    if (ec) {
+      return TRITONSERVER_ErrorNew(
+          TRITONSERVER_ERROR_INTERNAL,
+          (std::string("failed to list model directory of '") + model_path +
+           "': " + ec.message())
+              .c_str());
+    }
+    std::sort(entries.begin(), entries.end());
+    for (const auto& entry : entries) {
+      settings += entry + ";";
+    }
+  }
+
+  // Everything that changes the optimized graph: the ORT version, the
+  // CPU instruction set the layout transformations target, the device
+  // the session is placed on, and the configuration sections and
+  // parameters that feed the session options and execution providers.
+  // The other parameters only affect how the session is run.
+  settings += std::string(OrtGetApiBase()->GetVersionString()) + ";" +
+              CpuIsaSignature() + ";" +
+              TRITONSERVER_InstanceGroupKindString(instance_group_kind) + ";" +
+              std::to_string(instance_group_device_id) + ";" +
+              (OnnxLoader::IsGlobalThreadPoolEnabled() ? "1" : "0") + ";";
+  for (const char* section : {"optimization", "model_operations"}) {
+    triton::common::TritonJson::Value value;
+    if (model_config_.Find(section, &value)) {
+      triton::common::TritonJson::WriteBuffer buffer;
+      RETURN_IF_ERROR(value.Write(&buffer));
+      settings += std::string(section) + "=" + buffer.Contents() + ";";
+    }
+  }
+  triton::common::TritonJson::Value params;
+  if (model_config_.Find("parameters", &params)) {
+    for (const char* key :
+         {"execution_mode", "intra_op_thread_count", "inter_op_thread_count",
+          "enable_mem_arena", "enable_mem_pattern", "cudnn_conv_algo_search",
+          "gpu_mem_limit", "arena_extend_strategy",
+          "do_copy_in_default_stream"}) {
+      std::string value;
+      RETURN_IF_ERROR(TryParseModelStringParameter(params, key, &value, ""));
+      settings += std::string(key) + "=" + value + ";";
+    }
+  }
+  hash = HashBytes(settings.data(), settings.size(), hash);
+
+  std::stringstream ss;
+  ss << std::hex << std::setw(16) << std::setfill('0') << hash;
+  *cache_path =
+      JoinPath({optimized_model_cache_dir_, Name(), ss.str() + ".ort"});
+
+  return nullptr;  // success
+}
+
+TRITONSERVER_Error*
+ModelState::MapModelFile(const std::string& path, const MappedFile** file)
+{
+  std::string identity;
+  RETURN_IF_ERROR(MappedFile::Identity(path, &identity));
+  std::lock_guard<std::mutex> lk(mapped_files_mu_);
+  auto it = mapped_files_.find(identity);
+  if (it == mapped_files_.end()) {
+    // The file may have been replaced since, the mapping is keyed by the
+    // identity of the file actually mapped.
+    std::unique_ptr<MappedFile> mapped;
+    RETURN_IF_ERROR(MappedFile::Create(path, &mapped));
+    const std::string mapped_identity = mapped->FileIdentity();
+    it = mapped_files_.emplace(mapped_identity, std::move(mapped)).first;
+  }
+  *file = it->second.get();
+
+  return nullptr;  // success
+}
+
+TRITONSERVER_Error*
+ModelState::LoadModel(
+    const std::string& artifact_name,
+    const TRITONSERVER_InstanceGroupKind instance_group_kind,
+    const int32_t instance_group_device_id, std::string* model_path,
+    OrtSession** session, OrtAllocator** default_allocator, cudaStream_t stream,
+    LoadPhaseTimes* times, const InstanceSessionSettings* instance_settings)
+{
+  uint64_t phase_start_ns = LoadPhaseTimes::Now();
+
+  RETURN_IF_ERROR(ModelPath(artifact_name, model_path));
+
+  {
+    bool exists;
+    RETURN_IF_ERROR(FileExists(*model_path, &exists));
+    RETURN_ERROR_IF_FALSE(
+        exists, TRITONSERVER_ERROR_UNAVAILABLE,
+        std::string("unable to find '") + *model_path +
+            "' for model instance '" + Name() + "'");
+  }
+
+  phase_start_ns = times->Record("file_probe", phase_start_ns);
+
+  // Make a clone for the session options for this instance...
+  OrtSessionOptions* soptions;
+  RETURN_IF_ORT_ERROR(
+      ort_api->CloneSessionOptions(session_options_.get(), &soptions));
+  std::unique_ptr<OrtSessionOptions, SessionOptionsDeleter> soptions_wrapper(
+      soptions);
+
+  // Pin the intra-op threads to the cores of the instance, one thread
+  // per core. ORT doesn't pin the calling thread, which is the first of
+  // the intra-op threads, so the affinities start with the second core.
+  // ORT numbers the cores from 1.
+  const std::vector<int>* intra_op_cores =
+      (instance_settings != nullptr) ? &instance_settings->intra_op_cores
+                                     : nullptr;
+  const int numa_node =
+      (instance_settings != nullptr) ? instance_settings->numa_node : -1;
+  const int intra_op_thread_count =
+      ((instance_settings != nullptr) &&
+       (instance_settings->intra_op_thread_count > 0))
+          ? instance_settings->intra_op_thread_count
+          : intra_op_thread_count_;
+  // Number of intra-op threads of the session, 0 if ORT picks it.
+  size_t session_thread_cnt = std::max(intra_op_thread_count, 0);
+  if ((intra_op_cores != nullptr) && !intra_op_cores->empty()) {
+    const size_t thread_cnt = (intra_op_thread_count > 0)
+                                  ? (size_t)intra_op_thread_count
+                                  : intra_op_cores->size();
+    session_thread_cnt = thread_cnt;
+    RETURN_IF_ORT_ERROR(ort_api->SetIntraOpNumThreads(soptions, thread_cnt));
+    std::string affinities;
+    for (size_t idx = 1; idx < thread_cnt; ++idx) {
+      if (!affinities.empty()) {
+        affinities += ";";
+      }
+      affinities += std::to_string(
+          (*intra_op_cores)[idx % intra_op_cores->size()] + 1);
+    }
+    if (!affinities.empty()) {
+      RETURN_IF_ORT_ERROR(ort_api->AddSessionConfigEntry(
+          soptions, "session.intra_op_thread_affinities",
+          affinities.c_str()));
+    }
+  } else if (intra_op_thread_count != intra_op_thread_count_) {
+    RETURN_IF_ORT_ERROR(
+        ort_api->SetIntraOpNumThreads(soptions, intra_op_thread_count));
+  }
+
+  // ORT runs the asynchronous runs on the intra-op thread pool of the
+  // session and rejects them if it has fewer than two threads.
+  if (enable_async_run_ && !OnnxLoader::IsGlobalThreadPoolEnabled() &&
+      (session_thread_cnt == 1)) {
+    return TRITONSERVER_ErrorNew(
+        TRITONSERVER_ERROR_INVALID_ARG,
+        (std::string("enable_async_run requires at least 2 intra-op "
+                     "threads, but the session of '") +
+         ((instance_settings != nullptr) ? instance_settings->name : Name()) +
+         "' has 1")
+            .c_str());
+  }
+
+  // The threads of a session used by a single instance are named after
+  // the instance, the others after the model. ORT doesn't pin the
+  // threads it doesn't create, so the hooks pin them to the cores of
+  // the instance instead, each session from the second core as the
+  // affinities above. The session variants of an instance share its
+  // hooks.
+  OrtThreadHooks* thread_hooks = nullptr;
+  if (enable_ort_thread_hooks_) {
+    thread_hooks = ThreadHooksFor(
+        (instance_settings != nullptr) ? instance_settings->name : Name(),
+        intra_op_cores);
+    RETURN_IF_ORT_ERROR(thread_hooks->Install(soptions));
+  }
+  phase_start_ns = times->Record("option_clone", phase_start_ns);
+
+  bool need_lock = false;
+
+  // The optimized model can't be cached when the graph is compiled by
+  // an execution provider as the compiled nodes can't be saved.
+  bool cacheable = !optimized_model_cache_dir_.empty();
+
+  // Add execution providers if they are requested.
+  // Don't need to ensure uniqueness of the providers, ONNX Runtime
+  // will check it.
+
+  // GPU execution providers
+#ifdef TRITON_ENABLE_GPU
+  if ((instance_group_kind == TRITONSERVER_INSTANCEGROUPKIND_GPU) ||
+      (instance_group_kind == TRITONSERVER_INSTANCEGROUPKIND_AUTO)) {
+    std::map<std::string, std::string> cuda_options_map;
+    triton::common::TritonJson::Value optimization;
+    if (model_config_.Find("optimization", &optimization)) {
+      triton::common::TritonJson::Value eas;
+      if (optimization.Find("execution_accelerators", &eas)) {
+        triton::common::TritonJson::Value gpu_eas;
+        if (eas.Find("gpu_execution_accelerator", &gpu_eas)) {
+          for (size_t ea_idx = 0; ea_idx < gpu_eas.ArraySize(); ea_idx++) {
+            triton::common::TritonJson::Value ea;
+            RETURN_IF_ERROR(gpu_eas.IndexAsObject(ea_idx, &ea));
+            std::string name;
+            RETURN_IF_ERROR(ea.MemberAsString("name", &name));
+#ifdef TRITON_ENABLE_ONNXRUNTIME_TENSORRT
+            if (name == kTensorRTExecutionAccelerator) {
+              // create tensorrt options with default values
+              OrtTensorRTProviderOptionsV2* trt_options;
+              THROW_IF_BACKEND_MODEL_ORT_ERROR(
+                  ort_api->CreateTensorRTProviderOptions(&trt_options));
+              std::unique_ptr<
+                  OrtTensorRTProviderOptionsV2,
+                  decltype(ort_api->ReleaseTensorRTProviderOptions)>
+                  rel_trt_options(
+                      trt_options, ort_api->ReleaseTensorRTProviderOptions);
+              std::string int8_calibration_table_name;
+              std::string trt_engine_cache_path;
+              // Validate and set parameters
+              triton::common::TritonJson::Value params;
+              if (ea.Find("parameters", &params)) {
+                std::vector<std::string> param_keys, keys, values;
+                RETURN_IF_ERROR(params.Members(&param_keys));
+                for (const auto& param_key : param_keys) {
+                  std::string value_string, key, value;
+                  if (param_key == "precision_mode") {
+                    RETURN_IF_ERROR(params.MemberAsString(
+                        param_key.c_str(), &value_string));
+                    if (value_string == "FP16") {
+                      key = "trt_fp16_enable";
+                      value = "1";
+                    } else if (value_string == "INT8") {
+                      key = "trt_int8_enable";
+                      value = "1";
+                    } else if (value_string != "FP32") {
+                      RETURN_ERROR_IF_FALSE(
+                          false, TRITONSERVER_ERROR_INVALID_ARG,
+                          std::string("unsupported precision mode '") +
+                              value_string + "' is requested");
+                    }
+                  } else if (param_key == "max_workspace_size_bytes") {
+                    RETURN_IF_ERROR(params.MemberAsString(
+                        param_key.c_str(), &value_string));
+                    size_t max_workspace_size_bytes;
+                    RETURN_IF_ERROR(ParseUnsignedLongLongValue(
+                        value_string, &max_workspace_size_bytes));
+                    key = "trt_max_workspace_size";
+                    value = value_string;
+                  } else if (param_key == "trt_max_partition_iterations") {
+                    RETURN_IF_ERROR(params.MemberAsString(
+                        param_key.c_str(), &value_string));
                     int trt_max_partition_iterations;
                     RETURN_IF_ERROR(ParseIntValue(
                         value_string, &trt_max_partition_iterations));
@@ -703,6 +2281,7 @@ ModelState::LoadModel(
                   ort_api->SessionOptionsAppendExecutionProvider_TensorRT_V2(
                       static_cast<OrtSessionOptions*>(soptions),
                       rel_trt_options.get()));
+              cacheable = false;
               LOG_MESSAGE(
                   TRITONSERVER_LOG_VERBOSE,
                   (std::string("TensorRT Execution Accelerator is set for '") +
@@ -892,6 +2471,7 @@ ModelState::LoadModel(
 #ifdef TRITON_ENABLE_ONNXRUNTIME_OPENVINO
             if (name == kOpenVINOExecutionAccelerator) {
               need_lock = true;
+              cacheable = false;
               OrtOpenVINOProviderOptions openvino_options;
               openvino_options.device_type =
                   "CPU";  // device_type default is CPU
@@ -919,43 +2499,416 @@ ModelState::LoadModel(
     }
   }
 
-  // Register all op libraries that contain custom operations.
-  {
-    triton::common::TritonJson::Value model_ops;
-    if (model_config_.Find("model_operations", &model_ops)) {
-      triton::common::TritonJson::Value op_library_filenames;
-      if (model_ops.Find("op_library_filename", &op_library_filenames)) {
-        for (size_t op_idx = 0; op_idx < op_library_filenames.ArraySize();
-             op_idx++) {
-          std::string op_filename;
-          RETURN_IF_ERROR(
-              op_library_filenames.IndexAsString(op_idx, &op_filename));
-          void* library_handle = nullptr;
-          RETURN_IF_ORT_ERROR(ort_api->RegisterCustomOpsLibrary(
-              soptions, op_filename.c_str(), &library_handle));
-        }
+  // Register all op libraries that contain custom operations.
+  RETURN_IF_ERROR(RegisterCustomOpLibraries(soptions));
+
+  phase_start_ns = times->Record("ep_append", phase_start_ns);
+
+  // ONNX session creation with OpenVINO is not thread-safe,
+  // so multiple creations are serialized with a global lock.
+  static std::mutex global_context_mu;
+  std::unique_lock<std::mutex> glock(global_context_mu, std::defer_lock);
+  if (need_lock) {
+    glock.lock();
+    phase_start_ns = times->Record("ep_lock_wait", phase_start_ns);
+  }
+
+  // Create the session from 'path', or from a memory mapping of 'path'
+  // if requested. The mapping is shared by all sessions created from the
+  // same file and, when loading an ORT format model, ORT uses the mapped
+  // bytes directly for the graph and the initializers instead of copying
+  // them to the heap. External data of an ONNX model is looked up next to
+  // the model file.
+  if (enable_model_mmap_) {
+    RETURN_IF_ORT_ERROR(ort_api->AddSessionConfigEntry(
+        soptions, "session.use_ort_model_bytes_directly", "1"));
+    RETURN_IF_ORT_ERROR(ort_api->AddSessionConfigEntry(
+        soptions, "session.use_ort_model_bytes_for_initializers", "1"));
+    RETURN_IF_ORT_ERROR(ort_api->AddSessionConfigEntry(
+        soptions, "session.model_external_initializers_file_folder_path",
+        std::filesystem::path(*model_path).parent_path().string().c_str()));
+  }
+  auto load_session =
+      [&](const std::string& path,
+          const OrtSessionOptions* options) -> TRITONSERVER_Error* {
+    TRITONSERVER_Error* err = nullptr;
+    if (thread_hooks != nullptr) {
+      thread_hooks->ResetCores();
+    }
+    if (!enable_model_mmap_) {
+      err = OnnxLoader::LoadSession(
+          true /* is_path */, path, options, session,
+          PrepackedWeightsContainerFor(numa_node), times, numa_node);
+    } else {
+      const MappedFile* mapped = nullptr;
+      RETURN_IF_ERROR(MapModelFile(path, &mapped));
+      phase_start_ns = times->Record("model_mmap", phase_start_ns);
+      err = OnnxLoader::LoadSession(
+          mapped->Data(), mapped->Size(), options, session,
+          PrepackedWeightsContainerFor(numa_node), times, numa_node);
+    }
+    // The session creation phases are recorded by OnnxLoader.
+    phase_start_ns = LoadPhaseTimes::Now();
+    return err;
+  };
+
+  // Load the cached optimized model if there is one. Otherwise have ORT
+  // save the optimized model while creating the session so that the
+  // next load of the model can skip graph optimization. The model is
+  // saved to a temporary file and then renamed so that a concurrent
+  // load never reads a partially written model.
+  bool loaded = false;
+  std::string cache_path;
+  if (cacheable) {
+    RETURN_IF_ERROR(OptimizedModelCachePath(
+        *model_path, instance_group_kind, instance_group_device_id,
+        &cache_path));
+    bool cached = false;
+    RETURN_IF_ERROR(FileExists(cache_path, &cached));
+    phase_start_ns = times->Record("cache_probe", phase_start_ns);
+    if (cached) {
+      TRITONSERVER_Error* err = load_session(cache_path, soptions);
+      if (err == nullptr) {
+        loaded = true;
+        // Mark the entry as in use so that it is not removed as stale
+        // when another entry of the model is saved.
+        std::error_code ec;
+        std::filesystem::last_write_time(
+            cache_path, std::filesystem::file_time_type::clock::now(), ec);
+        LOG_MESSAGE(
+            TRITONSERVER_LOG_INFO,
+            (std::string("Loaded optimized model for '") + Name() +
+             "' from " + cache_path)
+                .c_str());
+      } else {
+        LOG_MESSAGE(
+            TRITONSERVER_LOG_WARN,
+            (std::string("Failed to load cached optimized model ") +
+             cache_path + ", falling back to " + *model_path + ": " +
+             TRITONSERVER_ErrorMessage(err))
+                .c_str());
+        TRITONSERVER_ErrorDelete(err);
+        std::remove(cache_path.c_str());
+      }
+    }
+  }
+
+  if (!loaded) {
+    // The model is saved with a copy of the session options so that the
+    // session can be created again without saving it if saving fails,
+    // for example for a model over 2 GB.
+    std::string cache_tmp_path;
+    std::unique_ptr<OrtSessionOptions, SessionOptionsDeleter> save_soptions;
+    if (!cache_path.empty()) {
+      std::error_code ec;
+      std::filesystem::create_directories(
+          std::filesystem::path(cache_path).parent_path(), ec);
+      if (ec) {
+        LOG_MESSAGE(
+            TRITONSERVER_LOG_WARN,
+            (std::string("Unable to create optimized model cache directory "
+                         "for '") +
+             Name() + "': " + ec.message())
+                .c_str());
+      } else {
+        cache_tmp_path =
+            cache_path + ".tmp" + std::to_string(std::random_device{}());
+#ifdef _WIN32
+        std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>> converter;
+        std::wstring ort_style_cache_tmp_path =
+            converter.from_bytes(cache_tmp_path);
+#else
+        const auto& ort_style_cache_tmp_path = cache_tmp_path;
+#endif
+        OrtSessionOptions* lsoptions;
+        RETURN_IF_ORT_ERROR(ort_api->CloneSessionOptions(soptions, &lsoptions));
+        save_soptions.reset(lsoptions);
+        RETURN_IF_ORT_ERROR(ort_api->SetOptimizedModelFilePath(
+            lsoptions, ort_style_cache_tmp_path.c_str()));
+        RETURN_IF_ORT_ERROR(ort_api->AddSessionConfigEntry(
+            lsoptions, "session.save_model_format", "ORT"));
+      }
+    }
+
+    if (save_soptions != nullptr) {
+      TRITONSERVER_Error* err =
+          load_session(*model_path, save_soptions.get());
+      if (err != nullptr) {
+        std::remove(cache_tmp_path.c_str());
+        cache_tmp_path.clear();
+        LOG_MESSAGE(
+            TRITONSERVER_LOG_WARN,
+            (std::string("Failed to save optimized model for '") + Name() +
+             "', loading it without caching: " +
+             TRITONSERVER_ErrorMessage(err))
+                .c_str());
+        TRITONSERVER_ErrorDelete(err);
+      } else {
+        loaded = true;
+      }
+    }
+    if (!loaded) {
+      RETURN_IF_ERROR(load_session(*model_path, soptions));
+    }
+
+    if (!cache_tmp_path.empty()) {
+      if (std::rename(cache_tmp_path.c_str(), cache_path.c_str()) == 0) {
+        LOG_MESSAGE(
+            TRITONSERVER_LOG_INFO,
+            (std::string("Saved optimized model for '") + Name() + "' to " +
+             cache_path)
+                .c_str());
+        // Entries of the model that no load has used for a day were
+        // made for a previous version of the model or configuration.
+        // Removing an entry still in use only costs it a rebuild, as
+        // open sessions keep the removed file alive.
+        const size_t removed =
+            RemoveStaleCacheFiles(cache_path, std::chrono::hours(24));
+        if (removed > 0) {
+          LOG_MESSAGE(
+              TRITONSERVER_LOG_VERBOSE,
+              (std::string("Removed ") + std::to_string(removed) +
+               " stale optimized model cache files for '" + Name() + "'")
+                  .c_str());
+        }
+      } else {
+        std::remove(cache_tmp_path.c_str());
+      }
+    }
+  }
+
+  // get default cpu allocator
+  RETURN_IF_ORT_ERROR(
+      ort_api->GetAllocatorWithDefaultOptions(default_allocator));
+
+  return nullptr;  // success
+}
+
+TRITONSERVER_Error*
+ModelState::RegisterCustomOpLibraries(OrtSessionOptions* soptions)
+{
+  triton::common::TritonJson::Value model_ops;
+  if (model_config_.Find("model_operations", &model_ops)) {
+    triton::common::TritonJson::Value op_library_filenames;
+    if (model_ops.Find("op_library_filename", &op_library_filenames)) {
+      for (size_t op_idx = 0; op_idx < op_library_filenames.ArraySize();
+           op_idx++) {
+        std::string op_filename;
+        RETURN_IF_ERROR(
+            op_library_filenames.IndexAsString(op_idx, &op_filename));
+        void* library_handle = nullptr;
+        RETURN_IF_ORT_ERROR(ort_api->RegisterCustomOpsLibrary(
+            soptions, op_filename.c_str(), &library_handle));
       }
     }
   }
 
-  // ONNX session creation with OpenVINO is not thread-safe,
-  // so multiple creations are serialized with a global lock.
-  static std::mutex global_context_mu;
-  std::unique_lock<std::mutex> glock(global_context_mu, std::defer_lock);
-  if (need_lock) {
-    glock.lock();
+  return nullptr;  // success
+}
+
+TRITONSERVER_Error*
+ModelState::LoadMetadataSession(
+    const std::string& artifact_name, std::string* model_path,
+    OrtSession** session, OrtAllocator** default_allocator,
+    LoadPhaseTimes* times)
+{
+  uint64_t phase_start_ns = LoadPhaseTimes::Now();
+
+  RETURN_IF_ERROR(ModelPath(artifact_name, model_path));
+
+  {
+    bool exists;
+    RETURN_IF_ERROR(FileExists(*model_path, &exists));
+    RETURN_ERROR_IF_FALSE(
+        exists, TRITONSERVER_ERROR_UNAVAILABLE,
+        std::string("unable to find '") + *model_path + "' for model '" +
+            Name() + "'");
+  }
+
+  OrtSessionOptions* soptions;
+  RETURN_IF_ORT_ERROR(
+      ort_api->CloneSessionOptions(session_options_.get(), &soptions));
+  std::unique_ptr<OrtSessionOptions, SessionOptionsDeleter> soptions_wrapper(
+      soptions);
+
+  // Only the graph inputs and outputs are read from the session, so skip
+  // the graph optimizations and the execution providers, and don't spin
+  // up thread pools that are never used.
+  RETURN_IF_ORT_ERROR(
+      ort_api->SetSessionGraphOptimizationLevel(soptions, ORT_DISABLE_ALL));
+  if (!OnnxLoader::IsGlobalThreadPoolEnabled()) {
+    RETURN_IF_ORT_ERROR(ort_api->SetIntraOpNumThreads(soptions, 1));
+    RETURN_IF_ORT_ERROR(ort_api->SetInterOpNumThreads(soptions, 1));
   }
+  RETURN_IF_ERROR(RegisterCustomOpLibraries(soptions));
+  times->Record("metadata_options", phase_start_ns);
 
   RETURN_IF_ERROR(OnnxLoader::LoadSession(
-      true /* is_path */, *model_path, soptions, session));
+      true /* is_path */, *model_path, soptions, session,
+      nullptr /* prepacked_weights_container */, times));
 
-  // get default cpu allocator
   RETURN_IF_ORT_ERROR(
       ort_api->GetAllocatorWithDefaultOptions(default_allocator));
 
   return nullptr;  // success
 }
 
+TRITONSERVER_Error*
+ModelState::SessionIOFor(
+    const std::string& artifact_name, OrtSession* session,
+    OrtAllocator* allocator, SessionIO* io)
+{
+  std::lock_guard<std::mutex> lk(session_ios_mu_);
+  auto it = session_ios_.find(artifact_name);
+  if (it == session_ios_.end()) {
+    SessionIO read_io;
+    RETURN_IF_ERROR(InputNames(session, read_io.input_names));
+    RETURN_IF_ERROR(InputInfos(session, allocator, read_io.input_infos));
+    RETURN_IF_ERROR(OverridableInitializerNames(
+        session, read_io.overridable_initializer_names));
+    RETURN_IF_ERROR(OverridableInitializerInfos(
+        session, allocator, read_io.overridable_initializer_infos));
+    RETURN_IF_ERROR(OutputNames(session, read_io.output_names));
+    RETURN_IF_ERROR(OutputInfos(session, allocator, read_io.output_infos));
+    it = session_ios_.emplace(artifact_name, std::move(read_io)).first;
+  }
+
+  *io = it->second;
+  return nullptr;  // success
+}
+
+void
+ModelState::SetSessionIOValidated(
+    const std::string& artifact_name, const OnnxTensorInfoMap& input_infos,
+    const std::unordered_map<std::string, std::vector<int64_t>>&
+        scalar_outputs)
+{
+  std::lock_guard<std::mutex> lk(session_ios_mu_);
+  auto it = session_ios_.find(artifact_name);
+  if (it != session_ios_.end()) {
+    it->second.input_infos = input_infos;
+    it->second.scalar_outputs = scalar_outputs;
+    it->second.validated = true;
+  }
+}
+
+TRITONSERVER_Error*
+ModelState::LoadSharedModel(
+    const std::string& artifact_name,
+    const TRITONSERVER_InstanceGroupKind instance_group_kind,
+    const int32_t instance_group_device_id, std::string* model_path,
+    std::shared_ptr<OrtSession>* session, OrtAllocator** default_allocator,
+    LoadPhaseTimes* times)
+{
+  const std::string key =
+      artifact_name + ":" +
+      TRITONSERVER_InstanceGroupKindString(instance_group_kind) + ":" +
+      std::to_string(instance_group_device_id);
+
+  const uint64_t wait_start_ns = LoadPhaseTimes::Now();
+  std::lock_guard<std::mutex> lk(shared_sessions_mu_);
+  times->Record("shared_session_wait", wait_start_ns);
+  std::shared_ptr<OrtSession> shared_session = shared_sessions_[key].lock();
+  if (shared_session == nullptr) {
+    // The session is shared by instances that each have their own CUDA
+    // stream so don't tie the session to any one of them, ORT will use
+    // its own stream for compute.
+    OrtSession* sptr = nullptr;
+    RETURN_IF_ERROR(LoadModel(
+        artifact_name, instance_group_kind, instance_group_device_id,
+        model_path, &sptr, default_allocator, nullptr /* stream */, times));
+    shared_session.reset(sptr, SessionDeleter());
+    shared_sessions_[key] = shared_session;
+
+    LOG_MESSAGE(
+        TRITONSERVER_LOG_INFO,
+        (std::string("Created session for '") + Name() + "' (" + key +
+         ") that is shared between instances")
+            .c_str());
+  } else {
+    RETURN_IF_ERROR(ModelPath(artifact_name, model_path));
+    RETURN_IF_ORT_ERROR(
+        ort_api->GetAllocatorWithDefaultOptions(default_allocator));
+  }
+
+  *session = shared_session;
+  return nullptr;  // success
+}
+
+void
+ModelState::ReportLoadPhaseTimes(
+    const std::string& source, const LoadPhaseTimes& times)
+{
+  LOG_MESSAGE(
+      TRITONSERVER_LOG_INFO,
+      (std::string("load phase times: model=") + Name() +
+       " version=" + std::to_string(Version()) + " " + source + " " +
+       times.ToString())
+          .c_str());
+
+  TRITONSERVER_MetricFamily* family =
+      BackendConfiguration::RetrieveFrom(TritonModel()).load_duration_family_;
+  if (family == nullptr) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lk(load_duration_metrics_mu_);
+  for (const auto& phase : times.Phases()) {
+    auto it = load_duration_metrics_.find(phase.first);
+    if (it == load_duration_metrics_.end()) {
+      const std::string version = std::to_string(Version());
+      std::vector<TRITONSERVER_Parameter*> labels{
+          TRITONSERVER_ParameterNew(
+              "model", TRITONSERVER_PARAMETER_STRING, Name().c_str()),
+          TRITONSERVER_ParameterNew(
+              "version", TRITONSERVER_PARAMETER_STRING, version.c_str()),
+          TRITONSERVER_ParameterNew(
+              "phase", TRITONSERVER_PARAMETER_STRING, phase.first.c_str())};
+      TRITONSERVER_Metric* metric = nullptr;
+      TRITONSERVER_Error* err = TRITONSERVER_MetricNew(
+          &metric, family,
+          const_cast<const TRITONSERVER_Parameter**>(labels.data()),
+          labels.size());
+      for (TRITONSERVER_Parameter* label : labels) {
+        TRITONSERVER_ParameterDelete(label);
+      }
+      if (err != nullptr) {
+        LOG_IF_ERROR(err, "failed to create load duration metric");
+        continue;
+      }
+      it = load_duration_metrics_.emplace(phase.first, metric).first;
+    }
+    LOG_IF_ERROR(
+        TRITONSERVER_MetricIncrement(it->second, phase.second / 1000.0),
+        "failed to increment load duration metric");
+  }
+}
+
+void
+ModelState::ReportTerminatedRun()
+{
+  LOG_MESSAGE(
+      TRITONSERVER_LOG_VERBOSE,
+      (std::string("Terminated a run of '") + Name() +
+       "' as all its requests were cancelled")
+          .c_str());
+  if (terminated_run_metric_ != nullptr) {
+    LOG_IF_ERROR(
+        TRITONSERVER_MetricIncrement(terminated_run_metric_, 1),
+        "failed to increment terminated run metric");
+  }
+}
+
+void
+ModelState::ReportRunAllocations(const uint64_t cnt)
+{
+  if ((cnt > 0) && (run_allocation_metric_ != nullptr)) {
+    LOG_IF_ERROR(
+        TRITONSERVER_MetricIncrement(run_allocation_metric_, cnt),
+        "failed to increment run allocation metric");
+  }
+}
+
 TRITONSERVER_Error*
 ModelState::AutoCompleteConfig()
 {
@@ -995,6 +2948,7 @@ ModelState::AutoCompleteConfig()
 
   // Must cleanup 'session'. 'allocator' is default allocator which
   // is managed by ONNX Runtime so don't need to free/release
+  LoadPhaseTimes times;
   std::unique_ptr<OrtSession, SessionDeleter> session;
   OrtAllocator* default_allocator;
   std::string model_path;
@@ -1025,26 +2979,40 @@ ModelState::AutoCompleteConfig()
     }
 #endif  // TRITON_ENABLE_GPU
 
+    // The inputs and outputs don't depend on the execution providers so
+    // read them from a session that is cheap to create, and only fall
+    // back to a full session if the model needs an execution provider
+    // to be loaded at all.
     OrtSession* sptr = nullptr;
-    RETURN_IF_ERROR(LoadModel(
-        artifact_name, kind, 0, &model_path, &sptr, &default_allocator,
-        nullptr));
+    TRITONSERVER_Error* err = LoadMetadataSession(
+        artifact_name, &model_path, &sptr, &default_allocator, &times);
+    if (err != nullptr) {
+      LOG_MESSAGE(
+          TRITONSERVER_LOG_VERBOSE,
+          (std::string("Unable to load a metadata session for '") + Name() +
+           "', loading a full session instead: " +
+           TRITONSERVER_ErrorMessage(err))
+              .c_str());
+      TRITONSERVER_ErrorDelete(err);
+      RETURN_IF_ERROR(LoadModel(
+          artifact_name, kind, 0, &model_path, &sptr, &default_allocator,
+          nullptr, &times));
+    }
     session.reset(sptr);
   }
-  OnnxTensorInfoMap input_tensor_infos;
-  RETURN_IF_ERROR(
-      InputInfos(session.get(), default_allocator, input_tensor_infos));
-  OnnxTensorInfoMap output_tensor_infos;
+  uint64_t phase_start_ns = LoadPhaseTimes::Now();
+  SessionIO io;
   RETURN_IF_ERROR(
-      OutputInfos(session.get(), default_allocator, output_tensor_infos));
-  RETURN_IF_ERROR(
-      AutoCompleteMaxBatch(input_tensor_infos, output_tensor_infos));
+      SessionIOFor(artifact_name, session.get(), default_allocator, &io));
+  RETURN_IF_ERROR(AutoCompleteMaxBatch(io.input_infos, io.output_infos));
   if (input_cnt == 0) {
-    RETURN_IF_ERROR(AutoCompleteIO("input", input_tensor_infos));
+    RETURN_IF_ERROR(AutoCompleteIO("input", io.input_infos));
   }
   if (output_cnt == 0) {
-    RETURN_IF_ERROR(AutoCompleteIO("output", output_tensor_infos));
+    RETURN_IF_ERROR(AutoCompleteIO("output", io.output_infos));
   }
+  times.Record("autocomplete", phase_start_ns);
+  ReportLoadPhaseTimes("source=autocomplete", times);
 
   if (TRITONSERVER_LogIsEnabled(TRITONSERVER_LOG_VERBOSE)) {
     triton::common::TritonJson::WriteBuffer buffer;
@@ -1218,29 +3186,272 @@ class ModelInstanceState : public BackendModelInstance {
       TRITONBACKEND_Request** requests, const uint32_t request_count);
 
  private:
+  // Run the model once for 'requests', whose batch sizes are given by
+  // 'batch_sizes'.
+  void ExecuteRequests(
+      TRITONBACKEND_Request** requests, const uint32_t request_count,
+      const size_t* batch_sizes, const uint64_t exec_start_ns);
+  // State of a single execution, from the gathering of the inputs until
+  // the responses are sent. Executions don't share any state so that an
+  // asynchronous execution can complete while the next one starts.
+  struct ExecutionContext {
+    ModelInstanceState* instance{nullptr};
+
+    // The session the execution runs on and, unless the model is run
+    // asynchronously, its IO binding. The IO binding of each session the
+    // context has run on is kept in 'io_bindings', so that switching
+    // between the session variants doesn't create them again. They are
+    // released along with the sessions.
+    std::shared_ptr<OrtSession> session;
+    OrtIoBinding* io_binding{nullptr};
+    std::unordered_map<OrtSession*, OrtIoBinding*> io_bindings;
+    // Run options of the context's runs, so that a run can be terminated
+    // without terminating the runs of the other contexts. 'terminated' is
+    // set once the run is terminated and is protected by 'running_mu_'.
+    OrtRunOptions* run_options{nullptr};
+    bool terminated{false};
+    // Number of intra-op threads the run counts for, see
+    // ModelState::AdmitRun().
+    size_t run_admission_weight{0};
+
+    std::vector<TRITONBACKEND_Request*> requests;
+    std::vector<TRITONBACKEND_Response*> responses;
+    bool all_response_failed{false};
+    size_t total_batch_size{0};
+    // Holds the buffers the inputs are gathered into, so it must live
+    // until the run completes. Constructed in place for each execution.
+    std::optional<BackendInputCollector> collector;
+
+    // Onnx Runtime variables that will be reset and used for every run.
+    // 'output_names' and 'output_tensors' are parallel vectors.
+    // 'input_tensors' point to tensors of 'cached_inputs' and
+    // 'padded_inputs', which are kept for the next runs, or to the
+    // tensors wrapping the buffers of a single request, which are owned
+    // by 'run_input_tensors' as their buffers change every run.
+    // 'output_tensors' are the tensors of 'cached_outputs' if all the
+    // outputs are bound to them, and are otherwise owned by the run and
+    // released with it, as reported by 'output_tensors_owned'.
+    std::vector<const char*> input_names;
+    std::vector<OrtValue*> input_tensors;
+    std::vector<std::unique_ptr<OrtValue, ValueDeleter>> run_input_tensors;
+    std::vector<const char*> output_names;
+    std::vector<OrtValue*> output_tensors;
+    bool output_tensors_owned{true};
+    OrtValue** output_buffer{nullptr};
+    // Pointers to the elements of the string input being set, kept so
+    // that their storage is reused by the next runs.
+    std::vector<const char*> string_ptrs;
+    // Number of tensors and buffers allocated for the execution, see
+    // ModelState::ReportRunAllocations().
+    uint64_t run_allocation_cnt{0};
+    // map of output name -> bound mem type and id
+    std::unordered_map<
+        std::string, std::pair<TRITONSERVER_MemoryType, int64_t>>
+        output_device_info;
+    // map of output name -> response buffer the output is written to.
+    // If 'bound' is false the buffer couldn't be bound, so the output is
+    // copied into it once read.
+    struct ResponseBuffer {
+      void* buffer;
+      size_t byte_size;
+      TRITONSERVER_MemoryType memory_type;
+      int64_t memory_type_id;
+      bool bound;
+    };
+    std::unordered_map<std::string, ResponseBuffer> response_buffers;
+
+    // map of input name -> staging buffer the input is gathered into
+    // and the tensors wrapping it, by shape. String inputs only have
+    // tensors. They are kept across runs so that batches with the same
+    // shapes don't allocate them again. 'padded_inputs' hold the
+    // bucketed inputs once padded and 'cached_outputs' the outputs bound
+    // ahead of the run.
+    struct CachedTensor {
+      std::unique_ptr<BackendMemory> memory;
+      std::map<std::vector<int64_t>, std::unique_ptr<OrtValue, ValueDeleter>>
+          tensors;
+    };
+    std::unordered_map<std::string, CachedTensor> cached_inputs;
+    std::unordered_map<std::string, CachedTensor> padded_inputs;
+    std::unordered_map<std::string, CachedTensor> cached_outputs;
+
+    // Size of the bucketed dimension of the inputs and the bucket it is
+    // padded up to, -1 if the model has no bucketed inputs.
+    int64_t bucket_length{-1};
+    int64_t bucket_size{-1};
+
+    uint64_t exec_start_ns{0};
+    uint64_t compute_start_ns{0};
+    uint64_t compute_end_ns{0};
+  };
+
   ModelInstanceState(
       ModelState* model_state,
       TRITONBACKEND_ModelInstance* triton_model_instance);
-  void ReleaseOrtRunResources();
+  // Load 'session_' and the sessions of 'session_variants_', adding the
+  // time spent in each phase to 'times'.
+  TRITONSERVER_Error* LoadSession(LoadPhaseTimes* times);
+  // Return the session a batch of 'total_batch_size' runs on, and in
+  // 'run_admission_weight' if not nullptr the number of intra-op
+  // threads the run counts for.
+  const std::shared_ptr<OrtSession>& SessionFor(
+      const size_t total_batch_size, size_t* run_admission_weight = nullptr);
+  // Release 'session_' once the instance has been idle for
+  // ModelState::SessionIdleTimeoutSec(), until the instance is destroyed.
+  void HibernateIdleSession();
+  // Wait for an idle execution context and return it.
+  ExecutionContext* AcquireExecutionContext();
+  void ReleaseExecutionContext(ExecutionContext* ctx);
+  // Make 'ctx' run a batch of 'total_batch_size' on the session picked
+  // by SessionFor(), loading the sessions again if they were released
+  // while the instance was idle, and count the execution as in flight.
+  TRITONSERVER_Error* AttachSession(
+      ExecutionContext* ctx, const size_t total_batch_size);
+  // Point 'ctx' to 'session' and to its IO binding, created the first
+  // time 'ctx' runs on 'session'. Must be called with 'session_mu_' held
+  // once the instance is constructed.
+  TRITONSERVER_Error* BindSession(
+      ExecutionContext* ctx, const std::shared_ptr<OrtSession>& session);
+  // Release the IO bindings of 'ctx' and detach it from its session.
+  void ReleaseSessionBindings(ExecutionContext* ctx);
+  // Read the outputs of the run of 'ctx', send the responses, report the
+  // statistics and release the requests and 'ctx'.
+  void CompleteExecution(ExecutionContext* ctx);
+  static void RunAsyncCallback(
+      void* user_data, OrtValue** outputs, size_t num_outputs,
+      OrtStatusPtr status);
+  // Stages of the pipelined execution, each run by its own thread. The
+  // run stage runs the model for the contexts in 'run_queue_' and hands
+  // them to the completion stage, which completes them in order.
+  void PipelineRunStage();
+  void PipelineCompletionStage();
+  // Run the model for the contexts in 'run_queue_' and complete them,
+  // see ModelState::RunWorkerCount().
+  void RunWorker();
+  // Remove from 'ctx' the requests whose response has already been sent
+  // with an error, and the cancelled requests once responded to, so the
+  // model is only run for the requests still waiting for a response.
+  // 'batch_sizes' and the total batch size of 'ctx' are updated to
+  // match.
+  void CompactRequests(
+      ExecutionContext* ctx, std::vector<size_t>* batch_sizes);
+  // Release the input tensors of 'ctx' so that they can be gathered
+  // again.
+  void ReleaseInputTensors(ExecutionContext* ctx);
+  // Mark the run of 'ctx' as in progress so that it is terminated once
+  // its requests are all cancelled, and wait for it to be admitted, see
+  // ModelState::AdmitRun(). Return a CANCELLED error instead if the
+  // requests are all cancelled already.
+  TRITONSERVER_Error* BeginRun(ExecutionContext* ctx);
+  // Mark the run of 'ctx' as complete and return whether it was
+  // terminated, in which case the terminate flag is reset.
+  bool EndRun(ExecutionContext* ctx);
+  // Whether the requests of 'ctx' that have not failed are all
+  // cancelled.
+  bool AllRequestsCancelled(ExecutionContext* ctx);
+  // Terminate the runs whose requests are all cancelled, until the
+  // instance is destroyed.
+  void TerminateCancelledRuns();
+  void ReleaseOrtRunResources(ExecutionContext* ctx);
   TRITONSERVER_Error* ValidateBooleanSequenceControl(
       triton::common::TritonJson::Value& sequence_batching,
       const std::string& control_kind, bool required, bool* have_control);
   TRITONSERVER_Error* ValidateTypedSequenceControl(
       triton::common::TritonJson::Value& sequence_batching,
       const std::string& control_kind, bool required, bool* have_control);
-  TRITONSERVER_Error* ValidateInputs(const size_t expected_input_cnt);
-  TRITONSERVER_Error* ValidateOutputs();
-  TRITONSERVER_Error* OrtRun(
-      std::vector<TRITONBACKEND_Response*>* responses,
-      const uint32_t response_count);
-  TRITONSERVER_Error* SetInputTensors(
-      size_t total_batch_size, TRITONBACKEND_Request** requests,
-      const uint32_t request_count,
-      std::vector<TRITONBACKEND_Response*>* responses,
-      BackendInputCollector* collector, std::vector<const char*>* input_names,
-      bool* cuda_copy);
+  // Validate the inputs and outputs of the model, including the sequence
+  // controls, against the model configuration.
+  TRITONSERVER_Error* ValidateIO(const ModelState::SessionIO& io);
+  // Validate that the session variant loaded from 'artifact_name', with
+  // inputs and outputs 'variant_io', has the same inputs and outputs as
+  // the main session, 'io'.
+  TRITONSERVER_Error* ValidateVariantIO(
+      const std::string& artifact_name, const ModelState::SessionIO& io,
+      const ModelState::SessionIO& variant_io);
+  TRITONSERVER_Error* ValidateInputs(
+      const size_t expected_input_cnt, const ModelState::SessionIO& io);
+  TRITONSERVER_Error* ValidateOutputs(const ModelState::SessionIO& io);
+  // Run the model on zero-filled inputs for each configured warmup batch
+  // size and dynamic dimension value.
+  TRITONSERVER_Error* WarmUp();
+  TRITONSERVER_Error* WarmUpRun(
+      const int64_t batch_size, const int64_t dim_value,
+      const std::unordered_map<std::string, std::vector<int64_t>>&
+          config_dims);
+  TRITONSERVER_Error* OrtRun(ExecutionContext* ctx);
+  // Start the run of 'ctx', which completes in RunAsyncCallback().
+  TRITONSERVER_Error* OrtRunAsync(ExecutionContext* ctx);
+  TRITONSERVER_Error* SetInputTensors(ExecutionContext* ctx, bool* cuda_copy);
+  TRITONSERVER_Error* SetOutputTensors(ExecutionContext* ctx);
+  // Create the output 'name' of the response of the single request of
+  // 'ctx' and bind it to the output buffer, preferably allocated in
+  // 'memory_type'. 'bound' returns false if the buffer can't be used by
+  // the session, in which case the output must be bound as usual.
+  TRITONSERVER_Error* BindResponseBuffer(
+      ExecutionContext* ctx, const std::string& name,
+      const ONNXTensorElementDataType type,
+      const TRITONSERVER_MemoryType memory_type, const int64_t memory_type_id,
+      bool* bound);
+  // Return in 'tensor' the cached tensor the output 'name' of 'ctx' can
+  // be written into, in 'memory_type' memory, or nullptr if the shape of
+  // the output is only known once the model has run.
+  TRITONSERVER_Error* GetCachedOutputTensor(
+      ExecutionContext* ctx, const std::string& name,
+      const OnnxTensorInfo& info, const TRITONSERVER_MemoryType memory_type,
+      OrtValue** tensor);
+  // Return the tensor of 'shape' wrapping the buffer of 'cached', the
+  // cached tensor 'name' of 'ctx', growing the buffer if needed. The
+  // buffer is in CPU memory if 'on_cpu' is true.
+  TRITONSERVER_Error* GetCachedTensor(
+      ExecutionContext* ctx, ExecutionContext::CachedTensor* cached,
+      const char* name, const TRITONSERVER_DataType datatype,
+      const std::vector<int64_t>& shape, const bool on_cpu,
+      OrtValue** tensor);
+  // Return the string tensor of 'shape' cached for the input 'name' of
+  // 'ctx', creating it if needed.
+  TRITONSERVER_Error* GetCachedStringTensor(
+      ExecutionContext* ctx, const char* name,
+      const std::vector<int64_t>& shape, OrtValue** tensor);
+  // Keep the number of cached tensors bounded for dynamic shapes.
+  static constexpr size_t kMaxCachedShapeCnt = 16;
+  // Return the tensor of 'shape' wrapping the input 'name' of the single
+  // request of 'ctx', used in place if in contiguous memory the session
+  // can read.
+  TRITONSERVER_Error* SetRequestInputTensor(
+      ExecutionContext* ctx, const char* name,
+      const TRITONSERVER_DataType datatype, const std::vector<int64_t>& shape,
+      OrtValue** tensor);
+  // Gather the input 'name' of the requests of 'ctx' into the staging
+  // buffer of the context and return the tensor of 'shape' wrapping it.
+  TRITONSERVER_Error* SetCachedInputTensor(
+      ExecutionContext* ctx, const char* name,
+      const TRITONSERVER_DataType datatype, const std::vector<int64_t>& shape,
+      OrtValue** tensor);
+  // An input gathered into 'src' that is padded into 'tensor' once the
+  // input copies complete, and bound then.
+  struct PendingPad {
+    const char* name;
+    TRITONSERVER_DataType datatype;
+    const char* src;
+    std::vector<int64_t> shape;
+    size_t dim;
+    OrtValue* tensor;
+  };
+  // Gather the bucketed input 'name' of the requests of 'ctx' and return
+  // in 'tensor' the tensor padded along 'dim' up to the bucket of the
+  // batch. If padding is needed it is added to 'pending_pads'.
+  TRITONSERVER_Error* SetBucketedInputTensor(
+      ExecutionContext* ctx, const char* name,
+      const TRITONSERVER_DataType datatype, const std::vector<int64_t>& shape,
+      const size_t dim, OrtValue** tensor,
+      std::vector<PendingPad>* pending_pads);
+  TRITONSERVER_Error* PadInputTensors(
+      ExecutionContext* ctx, const std::vector<PendingPad>& pending_pads);
+  // Generate ModelState::ShapeBucketMaskInput() for the bucket of 'ctx'.
+  TRITONSERVER_Error* SetShapeBucketMaskTensor(ExecutionContext* ctx);
   TRITONSERVER_Error* SetStringInputTensor(
-      TRITONBACKEND_Request** requests, const uint32_t request_count,
+      ExecutionContext* ctx, TRITONBACKEND_Request** requests,
+      const uint32_t request_count,
       std::vector<TRITONBACKEND_Response*>* responses, const char* input_name,
       std::vector<const char*>* string_ptrs, bool* cuda_copy);
   void SetStringInputBuffer(
@@ -1249,10 +3460,13 @@ class ModelInstanceState : public BackendModelInstance {
       std::vector<TRITONBACKEND_Response*>* responses, char* input_buffer,
       std::vector<const char*>* string_ptrs);
   void FillStringData(std::vector<const char*>* string_ptrs, size_t cnt);
-  TRITONSERVER_Error* ReadOutputTensors(
-      size_t total_batch_size, TRITONBACKEND_Request** requests,
-      const uint32_t request_count,
-      std::vector<TRITONBACKEND_Response*>* responses);
+  TRITONSERVER_Error* ReadOutputTensors(ExecutionContext* ctx);
+  // Copy 'output_tensor', allocated in 'tensor_memory', into the
+  // response buffer created for it.
+  TRITONSERVER_Error* CopyToResponseBuffer(
+      const std::string& name, OrtValue* output_tensor,
+      const std::pair<TRITONSERVER_MemoryType, int64_t>& tensor_memory,
+      const ExecutionContext::ResponseBuffer& buffer, bool* cuda_copy);
 
   TRITONSERVER_Error* ReadOutputTensor(
       std::vector<int64_t>& batchn_shape, TRITONSERVER_DataType& dtype,
@@ -1275,116 +3489,613 @@ class ModelInstanceState : public BackendModelInstance {
       const uint32_t request_count,
       std::vector<TRITONBACKEND_Response*>* responses, bool state);
 
-  ModelState* model_state_;
+  ModelState* model_state_;
+
+  // The full path to the ONNX model file.
+  std::string model_path_;
+
+  // Settings of the sessions loaded for the instance only.
+  ModelState::InstanceSessionSettings session_settings_;
+
+  // Number of intra-op threads a run of the instance counts for, see
+  // ModelState::AdmitRun(). 0 for GPU instances, whose runs are not
+  // admitted.
+  size_t run_admission_weight_;
+
+  // The sessions of the session variants of the model, see
+  // ModelState::SessionVariants(), in the same order. Their sessions are
+  // loaded and released along with 'session_'.
+  struct SessionVariant {
+    size_t max_batch_size;
+    std::string artifact_name;
+    ModelState::InstanceSessionSettings settings;
+    size_t run_admission_weight;
+    std::shared_ptr<OrtSession> session;
+  };
+  std::vector<SessionVariant> session_variants_;
+
+  // Onnx Runtime variables that are used across runs on this
+  // instance. 'session_' may be shared with other instances of the
+  // model, see ModelState::ShareSessionBetweenInstances().
+  std::shared_ptr<OrtSession> session_;
+  OrtAllocator* default_allocator_;
+  OrtMemoryInfo* cuda_allocator_info_;
+  const OrtMemoryInfo* cpu_allocator_info_;
+  OrtRunOptions* runOptions_;
+  // map of output name -> tensor info
+  OnnxTensorInfoMap output_tensor_infos_;
+
+  // map of input name -> tensor info, including the overridable
+  // initializers
+  OnnxTensorInfoMap input_tensor_infos_;
+
+  // names of the inputs of the model, excluding the overridable
+  // initializers
+  std::set<std::string> input_tensor_names_;
+
+  // A map from scalar output tensors to the dimension specified in model config
+  std::unordered_map<std::string, std::vector<int64_t>> scalar_outputs_;
+
+  // Execution contexts of the instance, one unless the model is run
+  // asynchronously or the executions are pipelined. 'idle_contexts_' are
+  // the ones that can be used by the next execution.
+  std::vector<std::unique_ptr<ExecutionContext>> contexts_;
+  std::mutex contexts_mu_;
+  std::condition_variable contexts_cv_;
+  std::vector<ExecutionContext*> idle_contexts_;
+
+  // Serializes the loading of the session with its release once the
+  // instance is idle. The session is only released when no execution is
+  // in flight. Once released, 'session_' and the IO bindings of the
+  // execution contexts are nullptr until the next execution loads them
+  // again, the tensor infos and other validated metadata are kept.
+  std::mutex session_mu_;
+  std::condition_variable hibernation_cv_;
+  size_t inflight_execution_cnt_;
+  std::chrono::steady_clock::time_point last_run_time_;
+  bool stop_hibernation_;
+  std::thread hibernation_thread_;
+
+  // Queues between the stages of the pipelined execution, see
+  // ModelState::EnablePipelinedExecution(). The run workers take their
+  // executions from 'run_queue_' too.
+  std::mutex pipeline_mu_;
+  std::condition_variable pipeline_cv_;
+  std::deque<ExecutionContext*> run_queue_;
+  std::deque<ExecutionContext*> completion_queue_;
+  bool stop_pipeline_;
+  std::thread pipeline_run_thread_;
+  std::thread pipeline_completion_thread_;
+  std::vector<std::thread> run_workers_;
+
+  // Contexts whose run is in progress, checked by
+  // 'run_termination_thread_' to terminate the runs whose requests are
+  // all cancelled. See ModelState::EnableRunTermination().
+  std::mutex running_mu_;
+  std::condition_variable running_cv_;
+  std::set<ExecutionContext*> running_contexts_;
+  bool stop_run_termination_;
+  std::thread run_termination_thread_;
+};
+
+TRITONSERVER_Error*
+ModelInstanceState::Create(
+    ModelState* model_state, TRITONBACKEND_ModelInstance* triton_model_instance,
+    ModelInstanceState** state)
+{
+  try {
+    *state = new ModelInstanceState(model_state, triton_model_instance);
+  }
+  catch (const BackendModelInstanceException& ex) {
+    RETURN_ERROR_IF_TRUE(
+        ex.err_ == nullptr, TRITONSERVER_ERROR_INTERNAL,
+        std::string("unexpected nullptr in BackendModelInstanceException"));
+    RETURN_IF_ERROR(ex.err_);
+  }
+
+  return nullptr;  // success
+}
+
+ModelInstanceState::ModelInstanceState(
+    ModelState* model_state, TRITONBACKEND_ModelInstance* triton_model_instance)
+    : BackendModelInstance(model_state, triton_model_instance),
+      model_state_(model_state), run_admission_weight_(0),
+      default_allocator_(nullptr), cuda_allocator_info_(nullptr),
+      cpu_allocator_info_(nullptr), inflight_execution_cnt_(0),
+      stop_hibernation_(false), stop_pipeline_(false),
+      stop_run_termination_(false)
+{
+  session_settings_.name = Name();
+  THROW_IF_BACKEND_INSTANCE_ERROR(model_state->IntraOpCoresFor(
+      triton_model_instance, &session_settings_.intra_op_cores,
+      &session_settings_.numa_node));
+  if (!session_settings_.intra_op_cores.empty()) {
+    std::string cores;
+    for (const int core : session_settings_.intra_op_cores) {
+      cores += (cores.empty() ? "" : ",") + std::to_string(core);
+    }
+    const int numa_node = session_settings_.numa_node;
+    LOG_MESSAGE(
+        TRITONSERVER_LOG_INFO,
+        (std::string("Pinning the intra-op threads of '") + Name() +
+         "' to CPU cores " + cores +
+         ((numa_node >= 0)
+              ? " and its sessions to NUMA node " + std::to_string(numa_node)
+              : std::string()))
+            .c_str());
+  }
+  // The runs of GPU instances mostly wait for the device, so they don't
+  // use the CPU the limit is about.
+  const bool admitted = (Kind() != TRITONSERVER_INSTANCEGROUPKIND_GPU);
+  run_admission_weight_ =
+      admitted ? model_state->RunAdmissionWeight(
+                     session_settings_.intra_op_cores.size())
+               : 0;
+  for (const auto& variant : model_state->SessionVariants()) {
+    SessionVariant lvariant;
+    lvariant.max_batch_size = variant.max_batch_size;
+    lvariant.artifact_name = variant.artifact_name.empty()
+                                 ? ArtifactFilename()
+                                 : variant.artifact_name;
+    lvariant.settings = session_settings_;
+    lvariant.settings.intra_op_thread_count = variant.intra_op_thread_count;
+    lvariant.run_admission_weight =
+        admitted ? model_state->RunAdmissionWeight(
+                       session_settings_.intra_op_cores.size(),
+                       variant.intra_op_thread_count)
+                 : 0;
+    session_variants_.push_back(std::move(lvariant));
+  }
+
+  LoadPhaseTimes times;
+  THROW_IF_BACKEND_INSTANCE_ERROR(LoadSession(&times));
+  uint64_t phase_start_ns = LoadPhaseTimes::Now();
+
+  // Each run worker has its own context.
+  int context_cnt = 1;
+  if (model_state->EnableAsyncRun() ||
+      model_state->EnablePipelinedExecution()) {
+    context_cnt = model_state->MaxInflightExecutions();
+  } else if (model_state->RunWorkerCount() > 0) {
+    context_cnt = model_state->RunWorkerCount();
+  }
+  for (int i = 0; i < context_cnt; ++i) {
+    contexts_.emplace_back(new ExecutionContext());
+    contexts_.back()->instance = this;
+    contexts_.back()->run_admission_weight = run_admission_weight_;
+    THROW_IF_BACKEND_INSTANCE_ERROR(
+        BindSession(contexts_.back().get(), session_));
+    idle_contexts_.push_back(contexts_.back().get());
+  }
+  phase_start_ns = times.Record("io_binding", phase_start_ns);
+
+  if (Kind() == TRITONSERVER_INSTANCEGROUPKIND_GPU) {
+    THROW_IF_BACKEND_INSTANCE_ORT_ERROR(ort_api->CreateMemoryInfo(
+        "Cuda", OrtAllocatorType::OrtArenaAllocator, DeviceId(),
+        OrtMemTypeDefault, &cuda_allocator_info_));
+  }
+
+  THROW_IF_BACKEND_INSTANCE_ORT_ERROR(
+      ort_api->AllocatorGetInfo(default_allocator_, &cpu_allocator_info_));
+
+  THROW_IF_BACKEND_INSTANCE_ORT_ERROR(ort_api->CreateRunOptions(&runOptions_));
+  for (auto& ctx : contexts_) {
+    THROW_IF_BACKEND_INSTANCE_ORT_ERROR(
+        ort_api->CreateRunOptions(&ctx->run_options));
+  }
+
+  // Read configs that needs to be set in RunOptions
+  triton::common::TritonJson::Value params;
+  if (model_state->ModelConfig().Find("parameters", &params)) {
+    triton::common::TritonJson::Value json_value;
+    const char* enable_memory_arena_shrinkage_key =
+        "memory.enable_memory_arena_shrinkage";
+    if (params.Find(enable_memory_arena_shrinkage_key, &json_value)) {
+      std::string string_value;
+      THROW_IF_BACKEND_MODEL_ERROR(
+          json_value.MemberAsString("string_value", &string_value));
+
+      LOG_MESSAGE(
+          TRITONSERVER_LOG_VERBOSE,
+          (std::string("Configuring ") + enable_memory_arena_shrinkage_key +
+           " to " + string_value)
+              .c_str());
+      THROW_IF_BACKEND_MODEL_ORT_ERROR(ort_api->AddRunConfigEntry(
+          runOptions_, enable_memory_arena_shrinkage_key,
+          string_value.c_str()));
+      for (auto& ctx : contexts_) {
+        THROW_IF_BACKEND_MODEL_ORT_ERROR(ort_api->AddRunConfigEntry(
+            ctx->run_options, enable_memory_arena_shrinkage_key,
+            string_value.c_str()));
+      }
+    }
+  }
+
+  phase_start_ns = times.Record("run_options", phase_start_ns);
+
+  // The inputs and outputs only need to be validated against the model
+  // configuration by the first instance loading the model file.
+  ModelState::SessionIO io;
+  THROW_IF_BACKEND_INSTANCE_ERROR(model_state->SessionIOFor(
+      ArtifactFilename(), session_.get(), default_allocator_, &io));
+  input_tensor_names_ = io.input_names;
+  input_tensor_infos_ = io.input_infos;
+  output_tensor_infos_ = io.output_infos;
+  scalar_outputs_ = io.scalar_outputs;
+  if (!io.validated) {
+    THROW_IF_BACKEND_INSTANCE_ERROR(ValidateIO(io));
+    model_state->SetSessionIOValidated(
+        ArtifactFilename(), input_tensor_infos_, scalar_outputs_);
+  }
+  for (const auto& variant : session_variants_) {
+    if (variant.artifact_name == ArtifactFilename()) {
+      continue;
+    }
+    ModelState::SessionIO variant_io;
+    THROW_IF_BACKEND_INSTANCE_ERROR(model_state->SessionIOFor(
+        variant.artifact_name, variant.session.get(), default_allocator_,
+        &variant_io));
+    THROW_IF_BACKEND_INSTANCE_ERROR(
+        ValidateVariantIO(variant.artifact_name, io, variant_io));
+  }
+  phase_start_ns = times.Record("validate_io", phase_start_ns);
+
+  if (model_state->EnableInstanceWarmup()) {
+    THROW_IF_BACKEND_INSTANCE_ERROR(WarmUp());
+    times.Record("warmup", phase_start_ns);
+  }
+
+  model_state->ReportLoadPhaseTimes("instance=" + Name(), times);
+
+  if (model_state->SessionIdleTimeoutSec() > 0) {
+    last_run_time_ = std::chrono::steady_clock::now();
+    hibernation_thread_ =
+        std::thread(&ModelInstanceState::HibernateIdleSession, this);
+  }
+
+  if (model_state->EnablePipelinedExecution()) {
+    pipeline_run_thread_ =
+        std::thread(&ModelInstanceState::PipelineRunStage, this);
+    pipeline_completion_thread_ =
+        std::thread(&ModelInstanceState::PipelineCompletionStage, this);
+  }
+  for (int i = 0; i < model_state->RunWorkerCount(); ++i) {
+    run_workers_.emplace_back(&ModelInstanceState::RunWorker, this);
+  }
+
+  if (model_state->EnableRunTermination()) {
+    run_termination_thread_ =
+        std::thread(&ModelInstanceState::TerminateCancelledRuns, this);
+  }
+}
+
+ModelInstanceState::~ModelInstanceState()
+{
+  // Wait for the asynchronous executions to complete.
+  {
+    std::unique_lock<std::mutex> lk(contexts_mu_);
+    contexts_cv_.wait(
+        lk, [this] { return idle_contexts_.size() == contexts_.size(); });
+  }
+
+  if (hibernation_thread_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lk(session_mu_);
+      stop_hibernation_ = true;
+    }
+    hibernation_cv_.notify_all();
+    hibernation_thread_.join();
+  }
+
+  // All the contexts are idle so the pipeline queues are empty.
+  {
+    std::lock_guard<std::mutex> lk(pipeline_mu_);
+    stop_pipeline_ = true;
+  }
+  pipeline_cv_.notify_all();
+  if (pipeline_run_thread_.joinable()) {
+    pipeline_run_thread_.join();
+    pipeline_completion_thread_.join();
+  }
+  for (auto& worker : run_workers_) {
+    worker.join();
+  }
+
+  if (run_termination_thread_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lk(running_mu_);
+      stop_run_termination_ = true;
+    }
+    running_cv_.notify_all();
+    run_termination_thread_.join();
+  }
+
+  for (auto& ctx : contexts_) {
+    ReleaseOrtRunResources(ctx.get());
+    ReleaseSessionBindings(ctx.get());
+    ort_api->ReleaseRunOptions(ctx->run_options);
+    ctx->cached_inputs.clear();
+    ctx->padded_inputs.clear();
+    ctx->cached_outputs.clear();
+  }
+  ort_api->ReleaseRunOptions(runOptions_);
+  ort_api->ReleaseMemoryInfo(cuda_allocator_info_);
+  // 'session_' is released by its deleter once no instance references it.
+  // 'default_allocator_' is default allocator which is managed by ONNX
+  // Runtime
+}
+
+TRITONSERVER_Error*
+ModelInstanceState::LoadSession(LoadPhaseTimes* times)
+{
+  // The sessions are only set once they are all loaded, so that a failed
+  // load is retried as a whole by the next execution instead of leaving
+  // some of them unset.
+  std::shared_ptr<OrtSession> main_session;
+  if (model_state_->ShareSessionBetweenInstances()) {
+    RETURN_IF_ERROR(model_state_->LoadSharedModel(
+        ArtifactFilename(), Kind(), DeviceId(), &model_path_, &main_session,
+        &default_allocator_, times));
+  } else {
+    OrtSession* session = nullptr;
+    RETURN_IF_ERROR(model_state_->LoadModel(
+        ArtifactFilename(), Kind(), DeviceId(), &model_path_, &session,
+        &default_allocator_, CudaStream(), times, &session_settings_));
+    main_session.reset(session, SessionDeleter());
+  }
 
-  // The full path to the ONNX model file.
-  std::string model_path_;
+  std::vector<std::shared_ptr<OrtSession>> variant_sessions;
+  for (auto& variant : session_variants_) {
+    std::string model_path;
+    OrtAllocator* allocator;
+    OrtSession* session = nullptr;
+    RETURN_IF_ERROR(model_state_->LoadModel(
+        variant.artifact_name, Kind(), DeviceId(), &model_path, &session,
+        &allocator, CudaStream(), times, &variant.settings));
+    variant_sessions.emplace_back(session, SessionDeleter());
+  }
 
-  // Onnx Runtime variables that are used across runs on this
-  // instance.
-  OrtSession* session_;
-  OrtAllocator* default_allocator_;
-  OrtMemoryInfo* cuda_allocator_info_;
-  const OrtMemoryInfo* cpu_allocator_info_;
-  OrtIoBinding* io_binding_;
-  OrtRunOptions* runOptions_;
-  // map of output name -> bound mem type and id
-  std::unordered_map<std::string, std::pair<TRITONSERVER_MemoryType, int64_t>>
-      output_device_info_;
-  // map of output name -> tensor info
-  OnnxTensorInfoMap output_tensor_infos_;
+  session_ = std::move(main_session);
+  for (size_t idx = 0; idx < session_variants_.size(); idx++) {
+    session_variants_[idx].session = std::move(variant_sessions[idx]);
+  }
 
-  // map of input name -> tensor info
-  OnnxTensorInfoMap input_tensor_infos_;
+  return nullptr;  // success
+}
 
-  // A map from scalar output tensors to the dimension specified in model config
-  std::unordered_map<std::string, std::vector<int64_t>> scalar_outputs_;
+const std::shared_ptr<OrtSession>&
+ModelInstanceState::SessionFor(
+    const size_t total_batch_size, size_t* run_admission_weight)
+{
+  for (const auto& variant : session_variants_) {
+    if (total_batch_size <= variant.max_batch_size) {
+      if (run_admission_weight != nullptr) {
+        *run_admission_weight = variant.run_admission_weight;
+      }
+      return variant.session;
+    }
+  }
+  if (run_admission_weight != nullptr) {
+    *run_admission_weight = run_admission_weight_;
+  }
+  return session_;
+}
 
-  // Onnx Runtime variables that will be reset and used for every run
-  // on this instance.
-  std::vector<OrtValue*> input_tensors_;
-  std::vector<OrtValue*> output_tensors_;
-  OrtValue** output_buffer_;
-  std::vector<BackendMemory*> input_tensor_memories_;
-};
+ModelInstanceState::ExecutionContext*
+ModelInstanceState::AcquireExecutionContext()
+{
+  std::unique_lock<std::mutex> lk(contexts_mu_);
+  contexts_cv_.wait(lk, [this] { return !idle_contexts_.empty(); });
+  ExecutionContext* ctx = idle_contexts_.back();
+  idle_contexts_.pop_back();
+  return ctx;
+}
 
-TRITONSERVER_Error*
-ModelInstanceState::Create(
-    ModelState* model_state, TRITONBACKEND_ModelInstance* triton_model_instance,
-    ModelInstanceState** state)
+void
+ModelInstanceState::ReleaseExecutionContext(ExecutionContext* ctx)
 {
-  try {
-    *state = new ModelInstanceState(model_state, triton_model_instance);
+  {
+    std::lock_guard<std::mutex> lk(contexts_mu_);
+    idle_contexts_.push_back(ctx);
   }
-  catch (const BackendModelInstanceException& ex) {
-    RETURN_ERROR_IF_TRUE(
-        ex.err_ == nullptr, TRITONSERVER_ERROR_INTERNAL,
-        std::string("unexpected nullptr in BackendModelInstanceException"));
-    RETURN_IF_ERROR(ex.err_);
+  contexts_cv_.notify_all();
+}
+
+TRITONSERVER_Error*
+ModelInstanceState::AttachSession(
+    ExecutionContext* ctx, const size_t total_batch_size)
+{
+  std::lock_guard<std::mutex> lk(session_mu_);
+  if (session_ == nullptr) {
+    LoadPhaseTimes times;
+    RETURN_IF_ERROR(LoadSession(&times));
+    model_state_->ReportLoadPhaseTimes(
+        "instance=" + Name() + " reload=idle", times);
+    hibernation_cv_.notify_all();
   }
+  RETURN_IF_ERROR(BindSession(
+      ctx, SessionFor(total_batch_size, &ctx->run_admission_weight)));
+  inflight_execution_cnt_++;
 
   return nullptr;  // success
 }
 
-ModelInstanceState::ModelInstanceState(
-    ModelState* model_state, TRITONBACKEND_ModelInstance* triton_model_instance)
-    : BackendModelInstance(model_state, triton_model_instance),
-      model_state_(model_state), session_(nullptr), default_allocator_(nullptr),
-      cuda_allocator_info_(nullptr), cpu_allocator_info_(nullptr),
-      io_binding_(nullptr), output_buffer_(nullptr)
+TRITONSERVER_Error*
+ModelInstanceState::BindSession(
+    ExecutionContext* ctx, const std::shared_ptr<OrtSession>& session)
 {
-  THROW_IF_BACKEND_INSTANCE_ERROR(model_state->LoadModel(
-      ArtifactFilename(), Kind(), DeviceId(), &model_path_, &session_,
-      &default_allocator_, CudaStream()));
+  if (ctx->session == session) {
+    return nullptr;  // success
+  }
 
-  if (Kind() == TRITONSERVER_INSTANCEGROUPKIND_GPU) {
-    THROW_IF_BACKEND_INSTANCE_ORT_ERROR(ort_api->CreateMemoryInfo(
-        "Cuda", OrtAllocatorType::OrtArenaAllocator, DeviceId(),
-        OrtMemTypeDefault, &cuda_allocator_info_));
+  // RunAsync doesn't support IO binding.
+  OrtIoBinding* io_binding = nullptr;
+  if (!model_state_->EnableAsyncRun()) {
+    auto it = ctx->io_bindings.find(session.get());
+    if (it != ctx->io_bindings.end()) {
+      io_binding = it->second;
+    } else {
+      RETURN_IF_ORT_ERROR(
+          ort_api->CreateIoBinding(session.get(), &io_binding));
+      ctx->io_bindings.emplace(session.get(), io_binding);
+    }
   }
+  ctx->io_binding = io_binding;
+  ctx->session = session;
 
-  THROW_IF_BACKEND_INSTANCE_ORT_ERROR(
-      ort_api->AllocatorGetInfo(default_allocator_, &cpu_allocator_info_));
+  return nullptr;  // success
+}
 
-  THROW_IF_BACKEND_INSTANCE_ORT_ERROR(
-      ort_api->CreateIoBinding(session_, &io_binding_));
+void
+ModelInstanceState::ReleaseSessionBindings(ExecutionContext* ctx)
+{
+  for (auto& io_binding : ctx->io_bindings) {
+    ort_api->ReleaseIoBinding(io_binding.second);
+  }
+  ctx->io_bindings.clear();
+  ctx->io_binding = nullptr;
+  ctx->session.reset();
+}
 
-  THROW_IF_BACKEND_INSTANCE_ORT_ERROR(ort_api->CreateRunOptions(&runOptions_));
+void
+ModelInstanceState::HibernateIdleSession()
+{
+  const std::chrono::seconds timeout(model_state_->SessionIdleTimeoutSec());
+  std::unique_lock<std::mutex> lk(session_mu_);
+  while (!stop_hibernation_) {
+    if ((session_ == nullptr) || (inflight_execution_cnt_ > 0)) {
+      // Wait for the next execution to load the session again, or for
+      // the executions in flight to complete.
+      hibernation_cv_.wait(lk);
+    } else if (std::chrono::steady_clock::now() - last_run_time_ >= timeout) {
+      // No execution is in flight so all the contexts are idle. A
+      // session shared with other instances is only released once all
+      // of them have released it.
+      for (auto& ctx : contexts_) {
+        ReleaseSessionBindings(ctx.get());
+        ctx->cached_inputs.clear();
+        ctx->padded_inputs.clear();
+        ctx->cached_outputs.clear();
+      }
+      session_.reset();
+      for (auto& variant : session_variants_) {
+        variant.session.reset();
+      }
+      LOG_MESSAGE(
+          TRITONSERVER_LOG_INFO,
+          (std::string("Released session of instance '") + Name() +
+           "' after being idle for " + std::to_string(timeout.count()) +
+           " seconds")
+              .c_str());
+    } else {
+      hibernation_cv_.wait_until(lk, last_run_time_ + timeout);
+    }
+  }
+}
 
-  // Read configs that needs to be set in RunOptions
-  triton::common::TritonJson::Value params;
-  if (model_state->ModelConfig().Find("parameters", &params)) {
-    triton::common::TritonJson::Value json_value;
-    const char* enable_memory_arena_shrinkage_key =
-        "memory.enable_memory_arena_shrinkage";
-    if (params.Find(enable_memory_arena_shrinkage_key, &json_value)) {
-      std::string string_value;
-      THROW_IF_BACKEND_MODEL_ERROR(
-          json_value.MemberAsString("string_value", &string_value));
+void
+ModelInstanceState::ReleaseOrtRunResources(ExecutionContext* ctx)
+{
+  // Nothing is bound if the session has been released or if the model
+  // is run asynchronously. The cached tensors are kept for the next
+  // runs.
+  ReleaseInputTensors(ctx);
+
+  // first release the Ortvalues
+  if (ctx->io_binding != nullptr) {
+    ort_api->ClearBoundOutputs(ctx->io_binding);
+  }
+  if (ctx->output_tensors_owned) {
+    for (auto& tensor : ctx->output_tensors) {
+      if (tensor != nullptr) {
+        ort_api->ReleaseValue(tensor);
+      }
+    }
+  }
+  ctx->output_tensors.clear();
+  ctx->output_tensors_owned = true;
+  ctx->run_allocation_cnt = 0;
+  ctx->output_names.clear();
+  ctx->output_device_info.clear();
+  ctx->response_buffers.clear();
 
+  // next release the allocated buffer using the specified allocator
+  if (ctx->output_buffer) {
+    auto free_status =
+        ort_api->AllocatorFree(default_allocator_, ctx->output_buffer);
+    ctx->output_buffer = nullptr;
+    if (free_status != nullptr) {
       LOG_MESSAGE(
-          TRITONSERVER_LOG_VERBOSE,
-          (std::string("Configuring ") + enable_memory_arena_shrinkage_key +
-           " to " + string_value)
+          TRITONSERVER_LOG_ERROR,
+          (std::string("onnx runtime allocator free error:") +
+           std::to_string(ort_api->GetErrorCode(free_status)) +
+           ort_api->GetErrorMessage(free_status))
               .c_str());
-      THROW_IF_BACKEND_MODEL_ORT_ERROR(ort_api->AddRunConfigEntry(
-          runOptions_, enable_memory_arena_shrinkage_key,
-          string_value.c_str()));
+      ort_api->ReleaseStatus(free_status);
+    }
+  }
+
+  ctx->requests.clear();
+  ctx->responses.clear();
+  ctx->all_response_failed = false;
+}
+
+TRITONSERVER_Error*
+ModelInstanceState::ValidateVariantIO(
+    const std::string& artifact_name, const ModelState::SessionIO& io,
+    const ModelState::SessionIO& variant_io)
+{
+  // The inputs of 'io' may have been merged with the overridable
+  // initializers, so only the names of the actual inputs are compared.
+  auto same_tensors = [](const std::set<std::string>& names,
+                         const std::set<std::string>& variant_names,
+                         const OnnxTensorInfoMap& infos,
+                         const OnnxTensorInfoMap& variant_infos) {
+    if (names != variant_names) {
+      return false;
     }
+    for (const auto& name : names) {
+      const auto it = infos.find(name);
+      const auto vit = variant_infos.find(name);
+      if ((it == infos.end()) || (vit == variant_infos.end()) ||
+          (it->second.type_ != vit->second.type_)) {
+        return false;
+      }
+    }
+    return true;
+  };
+  if (!same_tensors(
+          io.input_names, variant_io.input_names, io.input_infos,
+          variant_io.input_infos) ||
+      !same_tensors(
+          io.output_names, variant_io.output_names, io.output_infos,
+          variant_io.output_infos)) {
+    return TRITONSERVER_ErrorNew(
+        TRITONSERVER_ERROR_INVALID_ARG,
+        (std::string("unable to load session variant '") + artifact_name +
+         "' for model instance '" + Name() +
+         "', its inputs and outputs differ from the ones of '" +
+         ArtifactFilename() + "'")
+            .c_str());
   }
 
+  return nullptr;  // success
+}
+
+TRITONSERVER_Error*
+ModelInstanceState::ValidateIO(const ModelState::SessionIO& io)
+{
   size_t expected_input_cnt = 0;
   {
     triton::common::TritonJson::Value inputs;
-    if (model_state->ModelConfig().Find("input", &inputs)) {
+    if (model_state_->ModelConfig().Find("input", &inputs)) {
       expected_input_cnt = inputs.ArraySize();
       // Skip the optional inputs which are initializers
       for (size_t i = 0; i < inputs.ArraySize(); i++) {
         triton::common::TritonJson::Value input;
-        THROW_IF_BACKEND_INSTANCE_ERROR(inputs.IndexAsObject(i, &input));
+        RETURN_IF_ERROR(inputs.IndexAsObject(i, &input));
         bool is_optional;
-        THROW_IF_BACKEND_INSTANCE_ERROR(
-            input.MemberAsBool("optional", &is_optional));
+        RETURN_IF_ERROR(input.MemberAsBool("optional", &is_optional));
         if (is_optional) {
           expected_input_cnt--;
         }
@@ -1392,28 +4103,43 @@ ModelInstanceState::ModelInstanceState(
     }
 
     triton::common::TritonJson::Value config_batch_inputs;
-    if (model_state->ModelConfig().Find("batch_input", &config_batch_inputs)) {
+    if (model_state_->ModelConfig().Find(
+            "batch_input", &config_batch_inputs)) {
       expected_input_cnt += config_batch_inputs.ArraySize();
     }
+
+    // The mask of the shape bucketing is generated by the backend.
+    const std::string& mask_name = StateForModel()->ShapeBucketMaskInput();
+    if (!mask_name.empty()) {
+      if (io.input_names.count(mask_name) == 0) {
+        return TRITONSERVER_ErrorNew(
+            TRITONSERVER_ERROR_INVALID_ARG,
+            (std::string("unable to load model '") + model_state_->Name() +
+             "', shape_bucket_mask_input '" + mask_name +
+             "' is not an input of the model")
+                .c_str());
+      }
+      expected_input_cnt += 1;
+    }
   }
 
   // If this is a sequence model then make sure that the required
   // inputs are present in the model and have the correct shape and
   // datatype.
   triton::common::TritonJson::Value sequence_batching;
-  if (model_state->ModelConfig().Find(
+  if (model_state_->ModelConfig().Find(
           "sequence_batching", &sequence_batching)) {
     bool have_start, have_end, have_ready, have_corrid;
-    THROW_IF_BACKEND_INSTANCE_ERROR(ValidateBooleanSequenceControl(
+    RETURN_IF_ERROR(ValidateBooleanSequenceControl(
         sequence_batching, "CONTROL_SEQUENCE_START", false /* required */,
         &have_start));
-    THROW_IF_BACKEND_INSTANCE_ERROR(ValidateBooleanSequenceControl(
+    RETURN_IF_ERROR(ValidateBooleanSequenceControl(
         sequence_batching, "CONTROL_SEQUENCE_END", false /* required */,
         &have_end));
-    THROW_IF_BACKEND_INSTANCE_ERROR(ValidateBooleanSequenceControl(
+    RETURN_IF_ERROR(ValidateBooleanSequenceControl(
         sequence_batching, "CONTROL_SEQUENCE_READY", false /* required */,
         &have_ready));
-    THROW_IF_BACKEND_INSTANCE_ERROR(ValidateTypedSequenceControl(
+    RETURN_IF_ERROR(ValidateTypedSequenceControl(
         sequence_batching, "CONTROL_SEQUENCE_CORRID", false /* required */,
         &have_corrid));
     if (have_start) {
@@ -1436,63 +4162,10 @@ ModelInstanceState::ModelInstanceState(
     }
   }
 
-  THROW_IF_BACKEND_INSTANCE_ERROR(ValidateInputs(expected_input_cnt));
-  THROW_IF_BACKEND_INSTANCE_ERROR(ValidateOutputs());
-}
-
-ModelInstanceState::~ModelInstanceState()
-{
-  ReleaseOrtRunResources();
-  ort_api->ReleaseRunOptions(runOptions_);
-  ort_api->ReleaseIoBinding(io_binding_);
-  ort_api->ReleaseMemoryInfo(cuda_allocator_info_);
-  if (session_ != nullptr) {
-    OnnxLoader::UnloadSession(session_);
-  }
-  // 'default_allocator_' is default allocator which is managed by ONNX
-  // Runtime
-}
-
-void
-ModelInstanceState::ReleaseOrtRunResources()
-{
-  ort_api->ClearBoundInputs(io_binding_);
-  for (auto& tensor : input_tensors_) {
-    if (tensor != nullptr) {
-      ort_api->ReleaseValue(tensor);
-    }
-  }
-  input_tensors_.clear();
-
-  // first release the Ortvalues
-  ort_api->ClearBoundOutputs(io_binding_);
-  for (auto& tensor : output_tensors_) {
-    if (tensor != nullptr) {
-      ort_api->ReleaseValue(tensor);
-    }
-  }
-  output_tensors_.clear();
-
-  // next release the allocated buffer using the specified allocator
-  if (output_buffer_) {
-    auto free_status =
-        ort_api->AllocatorFree(default_allocator_, output_buffer_);
-    output_buffer_ = nullptr;
-    if (free_status != nullptr) {
-      LOG_MESSAGE(
-          TRITONSERVER_LOG_ERROR,
-          (std::string("onnx runtime allocator free error:") +
-           std::to_string(ort_api->GetErrorCode(free_status)) +
-           ort_api->GetErrorMessage(free_status))
-              .c_str());
-      ort_api->ReleaseStatus(free_status);
-    }
-  }
+  RETURN_IF_ERROR(ValidateInputs(expected_input_cnt, io));
+  RETURN_IF_ERROR(ValidateOutputs(io));
 
-  for (BackendMemory* mem : input_tensor_memories_) {
-    delete mem;
-  }
-  input_tensor_memories_.clear();
+  return nullptr;  // success
 }
 
 TRITONSERVER_Error*
@@ -1508,11 +4181,8 @@ ModelInstanceState::ValidateBooleanSequenceControl(
       nullptr, nullptr));
   *have_control = !tensor_name.empty();
   if (*have_control) {
-    OnnxTensorInfoMap input_tensor_infos;
-    RETURN_IF_ERROR(
-        InputInfos(session_, default_allocator_, input_tensor_infos));
-    const auto& iit = input_tensor_infos.find(tensor_name);
-    if (iit == input_tensor_infos.end()) {
+    const auto& iit = input_tensor_infos_.find(tensor_name);
+    if (iit == input_tensor_infos_.end()) {
       return TRITONSERVER_ErrorNew(
           TRITONSERVER_ERROR_INTERNAL,
           (std::string("configuration specified sequence control '") +
@@ -1565,11 +4235,8 @@ ModelInstanceState::ValidateTypedSequenceControl(
       &tensor_name, &tensor_datatype));
   *have_control = !tensor_name.empty();
   if (*have_control) {
-    OnnxTensorInfoMap input_tensor_infos;
-    RETURN_IF_ERROR(
-        InputInfos(session_, default_allocator_, input_tensor_infos));
-    const auto& iit = input_tensor_infos.find(tensor_name);
-    if (iit == input_tensor_infos.end()) {
+    const auto& iit = input_tensor_infos_.find(tensor_name);
+    if (iit == input_tensor_infos_.end()) {
       return TRITONSERVER_ErrorNew(
           TRITONSERVER_ERROR_INTERNAL,
           (std::string("configuration specified sequence control '") +
@@ -1611,20 +4278,14 @@ ModelInstanceState::ValidateTypedSequenceControl(
 }
 
 TRITONSERVER_Error*
-ModelInstanceState::ValidateInputs(const size_t expected_input_cnt)
+ModelInstanceState::ValidateInputs(
+    const size_t expected_input_cnt, const ModelState::SessionIO& io)
 {
-  std::set<std::string> input_tensor_names;
-  RETURN_IF_ERROR(InputNames(session_, input_tensor_names));
-  RETURN_IF_ERROR(
-      InputInfos(session_, default_allocator_, input_tensor_infos_));
-
-  std::set<std::string> overridable_initializer_tensor_names;
-  RETURN_IF_ERROR(OverridableInitializerNames(
-      session_, overridable_initializer_tensor_names));
-
-  OnnxTensorInfoMap overridable_initializer_tensor_infos;
-  RETURN_IF_ERROR(OverridableInitializerInfos(
-      session_, default_allocator_, overridable_initializer_tensor_infos));
+  std::set<std::string> input_tensor_names = io.input_names;
+  const auto& overridable_initializer_tensor_names =
+      io.overridable_initializer_names;
+  const auto& overridable_initializer_tensor_infos =
+      io.overridable_initializer_infos;
 
   if (input_tensor_infos_.size() != expected_input_cnt) {
     return TRITONSERVER_ErrorNew(
@@ -1758,13 +4419,9 @@ ModelInstanceState::ValidateInputs(const size_t expected_input_cnt)
 }
 
 TRITONSERVER_Error*
-ModelInstanceState::ValidateOutputs()
+ModelInstanceState::ValidateOutputs(const ModelState::SessionIO& io)
 {
-  std::set<std::string> output_tensor_names;
-  RETURN_IF_ERROR(OutputNames(session_, output_tensor_names));
-
-  RETURN_IF_ERROR(
-      OutputInfos(session_, default_allocator_, output_tensor_infos_));
+  const auto& output_tensor_names = io.output_names;
 
   triton::common::TritonJson::Value ios;
   RETURN_IF_ERROR(model_state_->ModelConfig().MemberAsArray("output", &ios));
@@ -1882,6 +4539,155 @@ ModelInstanceState::ValidateOutputs()
   return nullptr;  // success
 }
 
+TRITONSERVER_Error*
+ModelInstanceState::WarmUp()
+{
+  // The dimensions in the model configuration can be more specific than
+  // the ones of the model, so use them for the dynamic dimensions of the
+  // model when they are known.
+  std::unordered_map<std::string, std::vector<int64_t>> config_dims;
+  triton::common::TritonJson::Value ios;
+  RETURN_IF_ERROR(model_state_->ModelConfig().MemberAsArray("input", &ios));
+  for (size_t i = 0; i < ios.ArraySize(); i++) {
+    triton::common::TritonJson::Value io;
+    RETURN_IF_ERROR(ios.IndexAsObject(i, &io));
+    std::string io_name;
+    RETURN_IF_ERROR(io.MemberAsString("name", &io_name));
+    std::vector<int64_t> dims;
+    triton::common::TritonJson::Value reshape;
+    if (io.Find("reshape", &reshape)) {
+      RETURN_IF_ERROR(ParseShape(reshape, "shape", &dims));
+    } else {
+      RETURN_IF_ERROR(ParseShape(io, "dims", &dims));
+    }
+    config_dims.emplace(io_name, std::move(dims));
+  }
+
+  // Batch sizes only matter if the model supports batching.
+  std::vector<int64_t> batch_sizes{1};
+  if (model_state_->MaxBatchSize() > 0) {
+    batch_sizes = model_state_->WarmupBatchSizes();
+  }
+
+  uint64_t warmup_start_ns = 0;
+  SET_TIMESTAMP(warmup_start_ns);
+
+  size_t run_cnt = 0;
+  for (const int64_t batch_size : batch_sizes) {
+    for (const int64_t dim_value : model_state_->WarmupDimValues()) {
+      TRITONSERVER_Error* err = WarmUpRun(batch_size, dim_value, config_dims);
+      if (err != nullptr) {
+        TRITONSERVER_Error* warmup_err = TRITONSERVER_ErrorNew(
+            TRITONSERVER_ErrorCode(err),
+            (std::string("warmup of instance '") + Name() +
+             "' failed with batch size " + std::to_string(batch_size) +
+             " and dynamic dimension value " + std::to_string(dim_value) +
+             ": " + TRITONSERVER_ErrorMessage(err))
+                .c_str());
+        TRITONSERVER_ErrorDelete(err);
+        return warmup_err;
+      }
+      run_cnt++;
+    }
+  }
+
+  uint64_t warmup_end_ns = 0;
+  SET_TIMESTAMP(warmup_end_ns);
+
+  LOG_MESSAGE(
+      TRITONSERVER_LOG_INFO,
+      (std::string("Warmed up instance '") + Name() + "' with " +
+       std::to_string(run_cnt) + " runs in " +
+       std::to_string((warmup_end_ns - warmup_start_ns) / 1000000) + " ms")
+          .c_str());
+
+  return nullptr;  // success
+}
+
+TRITONSERVER_Error*
+ModelInstanceState::WarmUpRun(
+    const int64_t batch_size, const int64_t dim_value,
+    const std::unordered_map<std::string, std::vector<int64_t>>& config_dims)
+{
+  // Overridable initializers are not fed, only the actual model inputs.
+  const auto& input_tensor_names = input_tensor_names_;
+
+  const size_t batch_dim_cnt = (model_state_->MaxBatchSize() > 0) ? 1 : 0;
+  std::vector<const char*> input_names;
+  std::vector<std::unique_ptr<OrtValue, ValueDeleter>> input_values;
+  std::vector<const OrtValue*> input_value_ptrs;
+  for (const auto& name : input_tensor_names) {
+    auto iit = input_tensor_infos_.find(name);
+    if (iit == input_tensor_infos_.end()) {
+      return TRITONSERVER_ErrorNew(
+          TRITONSERVER_ERROR_INTERNAL,
+          (std::string("Failed to retrieve the ONNX input tensor info from '") +
+           name + "'.")
+              .c_str());
+    }
+
+    // Resolve the dynamic dimensions, the batch dimension from
+    // 'batch_size' and the others from the model configuration if known or
+    // else from 'dim_value'.
+    std::vector<int64_t> shape = iit->second.dims_;
+    const auto cit = config_dims.find(name);
+    for (size_t i = 0; i < shape.size(); ++i) {
+      if (shape[i] != WILDCARD_DIM) {
+        continue;
+      }
+      if (i < batch_dim_cnt) {
+        shape[i] = batch_size;
+      } else if (
+          (cit != config_dims.end()) &&
+          ((i - batch_dim_cnt) < cit->second.size()) &&
+          (cit->second[i - batch_dim_cnt] > 0)) {
+        shape[i] = cit->second[i - batch_dim_cnt];
+      } else {
+        shape[i] = dim_value;
+      }
+    }
+
+    // String tensors are created holding empty strings, the other tensors
+    // are zero-filled.
+    OrtValue* value;
+    RETURN_IF_ORT_ERROR(ort_api->CreateTensorAsOrtValue(
+        default_allocator_, shape.data(), shape.size(), iit->second.type_,
+        &value));
+    input_values.emplace_back(value);
+    if (iit->second.type_ != ONNX_TENSOR_ELEMENT_DATA_TYPE_STRING) {
+      void* data;
+      RETURN_IF_ORT_ERROR(ort_api->GetTensorMutableData(value, &data));
+      const size_t byte_size =
+          GetElementCount(shape) *
+          GetDataTypeByteSize(ConvertFromOnnxDataType(iit->second.type_));
+      memset(data, 0, byte_size);
+    }
+    input_names.push_back(name.c_str());
+    input_value_ptrs.push_back(value);
+  }
+
+  std::vector<const char*> output_names;
+  for (const auto& output : output_tensor_infos_) {
+    output_names.push_back(output.first.c_str());
+  }
+  std::vector<OrtValue*> output_values(output_names.size(), nullptr);
+
+  // Each batch size warms up the session it runs on.
+  OrtStatus* status = ort_api->Run(
+      SessionFor(batch_size).get(), runOptions_, input_names.data(),
+      input_value_ptrs.data(),
+      input_names.size(), output_names.data(), output_names.size(),
+      output_values.data());
+  for (OrtValue* value : output_values) {
+    if (value != nullptr) {
+      ort_api->ReleaseValue(value);
+    }
+  }
+  RETURN_IF_ORT_ERROR(status);
+
+  return nullptr;  // success
+}
+
 void
 ModelInstanceState::ProcessRequests(
     TRITONBACKEND_Request** requests, const uint32_t request_count)
@@ -1901,6 +4707,7 @@ ModelInstanceState::ProcessRequests(
   // execution. The batch-size, number of inputs, and size of each
   // input has already been checked so don't need to do that here.
   size_t total_batch_size = 0;
+  std::vector<size_t> batch_sizes(request_count, 1);
   for (size_t i = 0; i < request_count; i++) {
     // If we get a nullptr request then something is badly wrong. Fail
     // and release all requests.
@@ -1926,7 +4733,10 @@ ModelInstanceState::ProcessRequests(
         const int64_t* shape;
         err = TRITONBACKEND_InputProperties(
             input, nullptr, nullptr, &shape, nullptr, nullptr, nullptr);
-        total_batch_size += shape[0];
+        if (err == nullptr) {
+          batch_sizes[i] = shape[0];
+          total_batch_size += shape[0];
+        }
       }
       if (err != nullptr) {
         RequestsRespondWithError(requests, request_count, err);
@@ -1942,6 +4752,48 @@ ModelInstanceState::ProcessRequests(
     return;
   }
 
+  // Run the requests in sub-batches of at most ExecutionBatchSize(), or
+  // of at most the maximum batch size if the batch exceeds it. A sub-batch
+  // holds whole requests so a request larger than the sub-batch size is
+  // run on its own.
+  size_t sub_batch_size = model_state_->ExecutionBatchSize();
+  if ((max_batch_size > 0) &&
+      ((sub_batch_size == 0) || (sub_batch_size > (size_t)max_batch_size))) {
+    sub_batch_size = max_batch_size;
+  }
+  if ((max_batch_size > 0) && (total_batch_size > sub_batch_size)) {
+    uint32_t begin = 0;
+    while (begin < request_count) {
+      uint32_t end = begin;
+      size_t sub_total_batch_size = 0;
+      do {
+        sub_total_batch_size += batch_sizes[end++];
+      } while ((end < request_count) &&
+               (sub_total_batch_size + batch_sizes[end] <= sub_batch_size));
+      ExecuteRequests(
+          requests + begin, end - begin, batch_sizes.data() + begin,
+          exec_start_ns);
+      begin = end;
+    }
+    return;
+  }
+
+  ExecuteRequests(requests, request_count, batch_sizes.data(), exec_start_ns);
+}
+
+void
+ModelInstanceState::ExecuteRequests(
+    TRITONBACKEND_Request** requests, const uint32_t request_count,
+    const size_t* batch_sizes, const uint64_t exec_start_ns)
+{
+  const int max_batch_size = model_state_->MaxBatchSize();
+  std::vector<size_t> request_batch_sizes(
+      batch_sizes, batch_sizes + request_count);
+  size_t total_batch_size = 0;
+  for (const size_t batch_size : request_batch_sizes) {
+    total_batch_size += batch_size;
+  }
+
   // Make sure the maximum batch size is not exceeded. The
   // total_batch_size must be 1 for models that don't support batching
   // (i.e. max_batch_size == 0). If max_batch_size is exceeded then
@@ -1959,6 +4811,21 @@ ModelInstanceState::ProcessRequests(
     return;
   }
 
+  // Wait for an execution context, there is always one available unless
+  // the model is run asynchronously, pipelined or on run workers and the
+  // maximum number of executions are in flight. The session is kept
+  // loaded until the execution completes.
+  ExecutionContext* ctx = AcquireExecutionContext();
+  TRITONSERVER_Error* err = AttachSession(ctx, total_batch_size);
+  if (err != nullptr) {
+    RequestsRespondWithError(requests, request_count, err);
+    ReleaseExecutionContext(ctx);
+    return;
+  }
+  ctx->exec_start_ns = exec_start_ns;
+  ctx->total_batch_size = total_batch_size;
+  ctx->requests.assign(requests, requests + request_count);
+
   // At this point we are committed to running inference with all
   // 'requests'. Create a response for each request. During input
   // processing if there is an error with any request that error will
@@ -1970,9 +4837,8 @@ ModelInstanceState::ProcessRequests(
   // need the outputs for a request that has an error, we do need to
   // know the size of those outputs associated with the request so we
   // can skip them in the output tensors).
-  std::vector<TRITONBACKEND_Response*> responses;
+  std::vector<TRITONBACKEND_Response*>& responses = ctx->responses;
   responses.reserve(request_count);
-  bool all_response_failed = false;
 
   for (size_t i = 0; i < request_count; i++) {
     TRITONBACKEND_Response* response;
@@ -1986,194 +4852,737 @@ ModelInstanceState::ProcessRequests(
     }
   }
 
-  // Use scoped class to clean up ORT tensors and other resources that
-  // need to persist until ORT run completes.
-  struct ScopedCleanup {
-    ScopedCleanup(ModelInstanceState* ctx) : ctx_(ctx) {}
-    ~ScopedCleanup()
+  // Only run the model for the requests that are still waiting for a
+  // response. If a request fails while the inputs are gathered its rows
+  // are still in the batch, so the inputs are gathered again for the
+  // remaining requests. Each pass removes at least one request.
+  CompactRequests(ctx, &request_batch_sizes);
+  ctx->all_response_failed = ctx->requests.empty();
+  bool cuda_copy = false;
+  while (!ctx->all_response_failed) {
+    ctx->collector.emplace(
+        ctx->requests.data(), ctx->requests.size(), &responses,
+        model_state_->TritonMemoryManager(),
+        model_state_->EnablePinnedInput(), CudaStream(), nullptr, nullptr, 0,
+        HostPolicyName().c_str());
+    RESPOND_ALL_AND_SET_TRUE_IF_ERROR(
+        responses, ctx->requests.size(), ctx->all_response_failed,
+        SetInputTensors(ctx, &cuda_copy));
+    if (ctx->all_response_failed ||
+        (std::find(responses.begin(), responses.end(), nullptr) ==
+         responses.end())) {
+      break;
+    }
+
+    // The pending copies target the buffers about to be gathered again.
+#ifdef TRITON_ENABLE_GPU
+    if (cuda_copy) {
+      cudaStreamSynchronize(CudaStream());
+      cuda_copy = false;
+    }
+#endif  // TRITON_ENABLE_GPU
+    ReleaseInputTensors(ctx);
+    CompactRequests(ctx, &request_batch_sizes);
+    ctx->all_response_failed = ctx->requests.empty();
+  }
+
+  if (!ctx->all_response_failed) {
+    RESPOND_ALL_AND_SET_TRUE_IF_ERROR(
+        responses, ctx->requests.size(), ctx->all_response_failed,
+        SetOutputTensors(ctx));
+  }
+
+  // Wait for any in-flight input tensor copies to complete.
+#ifdef TRITON_ENABLE_GPU
+  if (cuda_copy) {
+    cudaStreamSynchronize(CudaStream());
+  }
+#endif
+
+  // The run and the completion of a pipelined execution happen on the
+  // stage threads, and those of the other executions on the run workers
+  // if any. The instance can then gather the inputs of the next
+  // requests.
+  if (model_state_->EnablePipelinedExecution() ||
+      (model_state_->RunWorkerCount() > 0)) {
+    {
+      std::lock_guard<std::mutex> lk(pipeline_mu_);
+      run_queue_.push_back(ctx);
+    }
+    pipeline_cv_.notify_all();
+    return;
+  }
+
+  SET_TIMESTAMP(ctx->compute_start_ns);
+
+  // An asynchronous run completes the execution from its callback, the
+  // instance can then be used for the next requests.
+  if (!ctx->all_response_failed && model_state_->EnableAsyncRun()) {
+    RESPOND_ALL_AND_SET_TRUE_IF_ERROR(
+        responses, ctx->requests.size(), ctx->all_response_failed,
+        OrtRunAsync(ctx));
+    if (!ctx->all_response_failed) {
+      return;
+    }
+  }
+
+  if (!ctx->all_response_failed) {
+    RESPOND_ALL_AND_SET_TRUE_IF_ERROR(
+        responses, ctx->requests.size(), ctx->all_response_failed,
+        OrtRun(ctx));
+  }
+  SET_TIMESTAMP(ctx->compute_end_ns);
+
+  CompleteExecution(ctx);
+}
+
+void
+ModelInstanceState::CompactRequests(
+    ExecutionContext* ctx, std::vector<size_t>* batch_sizes)
+{
+  uint64_t now_ns = 0;
+  SET_TIMESTAMP(now_ns);
+
+  size_t kept_cnt = 0;
+  for (size_t r = 0; r < ctx->requests.size(); ++r) {
+    TRITONBACKEND_Request* request = ctx->requests[r];
+    TRITONBACKEND_Response*& response = ctx->responses[r];
+    if (response != nullptr) {
+      bool is_cancelled = false;
+      TRITONSERVER_Error* err =
+          TRITONBACKEND_RequestIsCancelled(request, &is_cancelled);
+      if (err != nullptr) {
+        TRITONSERVER_ErrorDelete(err);
+      } else if (is_cancelled) {
+        RESPOND_AND_SET_NULL_IF_ERROR(
+            &response, TRITONSERVER_ErrorNew(
+                           TRITONSERVER_ERROR_CANCELLED,
+                           "request was cancelled before the run"));
+      }
+    }
+
+    if (response != nullptr) {
+      ctx->requests[kept_cnt] = request;
+      ctx->responses[kept_cnt] = response;
+      (*batch_sizes)[kept_cnt] = (*batch_sizes)[r];
+      ++kept_cnt;
+      continue;
+    }
+
+    ctx->total_batch_size -= (*batch_sizes)[r];
+    LOG_IF_ERROR(
+        TRITONBACKEND_ModelInstanceReportStatistics(
+            TritonModelInstance(), request, false /* success */,
+            ctx->exec_start_ns, now_ns, now_ns, now_ns),
+        "failed reporting request statistics");
+    LOG_IF_ERROR(
+        TRITONBACKEND_RequestRelease(request, TRITONSERVER_REQUEST_RELEASE_ALL),
+        "failed releasing request");
+  }
+
+  const size_t removed_cnt = ctx->requests.size() - kept_cnt;
+  if (removed_cnt > 0) {
+    ctx->requests.resize(kept_cnt);
+    ctx->responses.resize(kept_cnt);
+    batch_sizes->resize(kept_cnt);
+    LOG_MESSAGE(
+        TRITONSERVER_LOG_VERBOSE,
+        (std::string("Removed ") + std::to_string(removed_cnt) +
+         " failed or cancelled requests from the batch of '" + Name() +
+         "', running " + std::to_string(kept_cnt) + " requests")
+            .c_str());
+  }
+}
+
+void
+ModelInstanceState::ReleaseInputTensors(ExecutionContext* ctx)
+{
+  if (ctx->io_binding != nullptr) {
+    ort_api->ClearBoundInputs(ctx->io_binding);
+  }
+  ctx->input_tensors.clear();
+  ctx->run_input_tensors.clear();
+  ctx->input_names.clear();
+  ctx->bucket_length = -1;
+  ctx->bucket_size = -1;
+  ctx->collector.reset();
+}
+
+void
+ModelInstanceState::PipelineRunStage()
+{
+  while (true) {
+    ExecutionContext* ctx = nullptr;
+    {
+      std::unique_lock<std::mutex> lk(pipeline_mu_);
+      pipeline_cv_.wait(
+          lk, [this] { return stop_pipeline_ || !run_queue_.empty(); });
+      if (run_queue_.empty()) {
+        return;
+      }
+      ctx = run_queue_.front();
+      run_queue_.pop_front();
+    }
+
+    SET_TIMESTAMP(ctx->compute_start_ns);
+    if (!ctx->all_response_failed) {
+      RESPOND_ALL_AND_SET_TRUE_IF_ERROR(
+          ctx->responses, ctx->requests.size(), ctx->all_response_failed,
+          OrtRun(ctx));
+    }
+    SET_TIMESTAMP(ctx->compute_end_ns);
+
+    {
+      std::lock_guard<std::mutex> lk(pipeline_mu_);
+      completion_queue_.push_back(ctx);
+    }
+    pipeline_cv_.notify_all();
+  }
+}
+
+void
+ModelInstanceState::PipelineCompletionStage()
+{
+  while (true) {
+    ExecutionContext* ctx = nullptr;
+    {
+      std::unique_lock<std::mutex> lk(pipeline_mu_);
+      pipeline_cv_.wait(
+          lk, [this] { return stop_pipeline_ || !completion_queue_.empty(); });
+      if (completion_queue_.empty()) {
+        return;
+      }
+      ctx = completion_queue_.front();
+      completion_queue_.pop_front();
+    }
+
+    CompleteExecution(ctx);
+  }
+}
+
+void
+ModelInstanceState::RunWorker()
+{
+  while (true) {
+    ExecutionContext* ctx = nullptr;
+    {
+      std::unique_lock<std::mutex> lk(pipeline_mu_);
+      pipeline_cv_.wait(
+          lk, [this] { return stop_pipeline_ || !run_queue_.empty(); });
+      if (run_queue_.empty()) {
+        return;
+      }
+      ctx = run_queue_.front();
+      run_queue_.pop_front();
+    }
+
+    SET_TIMESTAMP(ctx->compute_start_ns);
+    if (!ctx->all_response_failed) {
+      RESPOND_ALL_AND_SET_TRUE_IF_ERROR(
+          ctx->responses, ctx->requests.size(), ctx->all_response_failed,
+          OrtRun(ctx));
+    }
+    SET_TIMESTAMP(ctx->compute_end_ns);
+
+    CompleteExecution(ctx);
+  }
+}
+
+void
+ModelInstanceState::CompleteExecution(ExecutionContext* ctx)
+{
+  std::vector<TRITONBACKEND_Response*>& responses = ctx->responses;
+  const uint32_t request_count = ctx->requests.size();
+
+  if (!ctx->all_response_failed) {
+    RESPOND_ALL_AND_SET_TRUE_IF_ERROR(
+        responses, request_count, ctx->all_response_failed,
+        ReadOutputTensors(ctx));
+  }
+
+  uint64_t exec_end_ns = 0;
+  SET_TIMESTAMP(exec_end_ns);
+
+  // Send all the responses that haven't already been sent because of
+  // an earlier error. Note that the responses are not set to nullptr
+  // here as we need that indication below to determine if the request
+  // we successful or not.
+  for (auto& response : responses) {
+    if (response != nullptr) {
+      LOG_IF_ERROR(
+          TRITONBACKEND_ResponseSend(
+              response, TRITONSERVER_RESPONSE_COMPLETE_FINAL, nullptr),
+          "failed to send onnxruntime backend response");
+    }
+  }
+
+  // Report statistics for each request.
+  for (uint32_t r = 0; r < request_count; ++r) {
+    auto& request = ctx->requests[r];
+    LOG_IF_ERROR(
+        TRITONBACKEND_ModelInstanceReportStatistics(
+            TritonModelInstance(), request,
+            (responses[r] != nullptr) /* success */, ctx->exec_start_ns,
+            ctx->compute_start_ns, ctx->compute_end_ns, exec_end_ns),
+        "failed reporting request statistics");
+
+    LOG_IF_ERROR(
+        TRITONBACKEND_RequestRelease(request, TRITONSERVER_REQUEST_RELEASE_ALL),
+        "failed releasing request");
+  }
+
+  if (!ctx->all_response_failed) {
+    // Report the entire batch statistics.
+    LOG_IF_ERROR(
+        TRITONBACKEND_ModelInstanceReportBatchStatistics(
+            TritonModelInstance(), ctx->total_batch_size, ctx->exec_start_ns,
+            ctx->compute_start_ns, ctx->compute_end_ns, exec_end_ns),
+        "failed reporting batch request statistics");
+  }
+
+  StateForModel()->ReportRunAllocations(ctx->run_allocation_cnt);
+  ReleaseOrtRunResources(ctx);
+  model_state_->ReportThreadCpuTime();
+
+  {
+    std::lock_guard<std::mutex> lk(session_mu_);
+    inflight_execution_cnt_--;
+    last_run_time_ = std::chrono::steady_clock::now();
+  }
+  hibernation_cv_.notify_all();
+
+  ReleaseExecutionContext(ctx);
+}
+
+bool
+ModelInstanceState::AllRequestsCancelled(ExecutionContext* ctx)
+{
+  for (size_t idx = 0; idx < ctx->requests.size(); idx++) {
+    if (ctx->responses[idx] == nullptr) {
+      continue;
+    }
+    bool is_cancelled = false;
+    TRITONSERVER_Error* err =
+        TRITONBACKEND_RequestIsCancelled(ctx->requests[idx], &is_cancelled);
+    if (err != nullptr) {
+      TRITONSERVER_ErrorDelete(err);
+      return false;
+    }
+    if (!is_cancelled) {
+      return false;
+    }
+  }
+  return true;
+}
+
+TRITONSERVER_Error*
+ModelInstanceState::BeginRun(ExecutionContext* ctx)
+{
+  // The run is watched while it waits to be admitted, so that it stops
+  // right away if its requests are cancelled meanwhile.
+  if (model_state_->EnableRunTermination()) {
+    if (AllRequestsCancelled(ctx)) {
+      model_state_->ReportTerminatedRun();
+      return TRITONSERVER_ErrorNew(
+          TRITONSERVER_ERROR_CANCELLED, "all the requests were cancelled");
+    }
     {
-      if (ctx_ != nullptr) {
-        ctx_->ReleaseOrtRunResources();
+      std::lock_guard<std::mutex> lk(running_mu_);
+      running_contexts_.insert(ctx);
+    }
+    running_cv_.notify_all();
+  }
+  model_state_->AdmitRun(ctx->run_admission_weight);
+
+  return nullptr;  // success
+}
+
+bool
+ModelInstanceState::EndRun(ExecutionContext* ctx)
+{
+  model_state_->EndAdmittedRun(ctx->run_admission_weight);
+  if (!model_state_->EnableRunTermination()) {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lk(running_mu_);
+  running_contexts_.erase(ctx);
+  const bool terminated = ctx->terminated;
+  if (terminated) {
+    LOG_IF_ORT_ERROR(
+        ort_api->RunOptionsUnsetTerminate(ctx->run_options),
+        "failed to reset run termination");
+    ctx->terminated = false;
+    model_state_->ReportTerminatedRun();
+  }
+  return terminated;
+}
+
+void
+ModelInstanceState::TerminateCancelledRuns()
+{
+  const std::chrono::milliseconds interval(
+      model_state_->RunTerminationCheckIntervalMs());
+  std::unique_lock<std::mutex> lk(running_mu_);
+  while (!stop_run_termination_) {
+    if (running_contexts_.empty()) {
+      running_cv_.wait(lk);
+      continue;
+    }
+    running_cv_.wait_for(lk, interval);
+    for (ExecutionContext* ctx : running_contexts_) {
+      if (!ctx->terminated && AllRequestsCancelled(ctx)) {
+        LOG_IF_ORT_ERROR(
+            ort_api->RunOptionsSetTerminate(ctx->run_options),
+            "failed to terminate run");
+        ctx->terminated = true;
+      }
+    }
+  }
+}
+
+TRITONSERVER_Error*
+ModelInstanceState::OrtRun(ExecutionContext* ctx)
+{
+  RETURN_IF_ERROR(BeginRun(ctx));
+  OrtStatus* status = ort_api->RunWithBinding(
+      ctx->session.get(), ctx->run_options, ctx->io_binding);
+  if (EndRun(ctx)) {
+    if (status != nullptr) {
+      ort_api->ReleaseStatus(status);
+    }
+    return TRITONSERVER_ErrorNew(
+        TRITONSERVER_ERROR_CANCELLED,
+        "the run was terminated as all the requests were cancelled");
+  }
+  RETURN_IF_ORT_ERROR(status);
+  return nullptr;
+}
+
+TRITONSERVER_Error*
+ModelInstanceState::OrtRunAsync(ExecutionContext* ctx)
+{
+  RETURN_IF_ERROR(BeginRun(ctx));
+  OrtStatus* status = ort_api->RunAsync(
+      ctx->session.get(), ctx->run_options, ctx->input_names.data(),
+      ctx->input_tensors.data(), ctx->input_tensors.size(),
+      ctx->output_names.data(), ctx->output_names.size(),
+      ctx->output_tensors.data(), RunAsyncCallback, ctx);
+  if (status != nullptr) {
+    EndRun(ctx);
+  }
+  RETURN_IF_ORT_ERROR(status);
+  return nullptr;
+}
+
+void
+ModelInstanceState::RunAsyncCallback(
+    void* user_data, OrtValue** outputs, size_t num_outputs,
+    OrtStatusPtr status)
+{
+  // 'outputs' is the 'output_tensors' of the context, released with the
+  // other resources of the run if allocated by ORT.
+  ExecutionContext* ctx = reinterpret_cast<ExecutionContext*>(user_data);
+  SET_TIMESTAMP(ctx->compute_end_ns);
+  if (ctx->output_tensors_owned) {
+    ctx->run_allocation_cnt += num_outputs;
+  }
+  if (ctx->instance->EndRun(ctx)) {
+    if (status != nullptr) {
+      ort_api->ReleaseStatus(status);
+    }
+    RESPOND_ALL_AND_SET_TRUE_IF_ERROR(
+        ctx->responses, ctx->requests.size(), ctx->all_response_failed,
+        TRITONSERVER_ErrorNew(
+            TRITONSERVER_ERROR_CANCELLED,
+            "the run was terminated as all the requests were cancelled"));
+  } else {
+    RESPOND_ALL_AND_SET_TRUE_IF_ORT_ERROR(
+        ctx->responses, ctx->requests.size(), ctx->all_response_failed,
+        status);
+  }
+  ctx->instance->CompleteExecution(ctx);
+}
+
+TRITONSERVER_Error*
+ModelInstanceState::BindResponseBuffer(
+    ExecutionContext* ctx, const std::string& name,
+    const ONNXTensorElementDataType type,
+    const TRITONSERVER_MemoryType memory_type, const int64_t memory_type_id,
+    bool* bound)
+{
+  *bound = false;
+
+  std::vector<int64_t> shape;
+  if (model_state_->MaxBatchSize() > 0) {
+    shape.push_back(ctx->total_batch_size);
+  }
+  const auto& dims = StateForModel()->StaticOutputDims().at(name);
+  shape.insert(shape.end(), dims.begin(), dims.end());
+  const TRITONSERVER_DataType datatype = ConvertFromOnnxDataType(type);
+  const int64_t byte_size = GetByteSize(datatype, shape);
+  if (byte_size <= 0) {
+    return nullptr;  // bind as usual
+  }
+
+  // Once created the output can't be created again for the response, so
+  // it is copied into the buffer if the buffer can't be bound.
+  TRITONBACKEND_Response** response = &ctx->responses[0];
+  TRITONBACKEND_Output* output;
+  RESPOND_AND_SET_NULL_IF_ERROR(
+      response, TRITONBACKEND_ResponseOutput(
+                    *response, &output, name.c_str(), datatype, shape.data(),
+                    shape.size()));
+  if (*response == nullptr) {
+    return nullptr;  // bind as usual
+  }
+  ExecutionContext::ResponseBuffer& buffer = ctx->response_buffers[name];
+  buffer.byte_size = byte_size;
+  buffer.memory_type = memory_type;
+  buffer.memory_type_id = memory_type_id;
+  buffer.bound = false;
+  RESPOND_AND_SET_NULL_IF_ERROR(
+      response, TRITONBACKEND_OutputBuffer(
+                    output, &buffer.buffer, byte_size, &buffer.memory_type,
+                    &buffer.memory_type_id));
+  if (*response == nullptr) {
+    ctx->response_buffers.erase(name);
+    return nullptr;  // bind as usual
+  }
+
+  OrtMemoryInfo* allocator_info = cpu_allocator_info_;
+  if (buffer.memory_type == TRITONSERVER_MEMORY_GPU) {
+    if ((cuda_allocator_info_ == nullptr) ||
+        (buffer.memory_type_id != DeviceId())) {
+      return nullptr;  // bind as usual
+    }
+    allocator_info = cuda_allocator_info_;
+  }
+
+  OrtValue* tensor;
+  RETURN_IF_ORT_ERROR(ort_api->CreateTensorWithDataAsOrtValue(
+      allocator_info, buffer.buffer, byte_size, shape.data(), shape.size(),
+      type, &tensor));
+  ctx->run_allocation_cnt++;
+  // The binding holds its own reference to the tensor.
+  std::unique_ptr<OrtValue, ValueDeleter> tensor_holder(tensor);
+  RETURN_IF_ORT_ERROR(
+      ort_api->BindOutput(ctx->io_binding, name.c_str(), tensor));
+  ctx->output_device_info[name] = {buffer.memory_type, buffer.memory_type_id};
+  buffer.bound = true;
+  *bound = true;
+
+  return nullptr;  // success
+}
+
+TRITONSERVER_Error*
+ModelInstanceState::GetCachedOutputTensor(
+    ExecutionContext* ctx, const std::string& name, const OnnxTensorInfo& info,
+    const TRITONSERVER_MemoryType memory_type, OrtValue** tensor)
+{
+  *tensor = nullptr;
+
+  // Bucketed outputs have the shape of the bucket, trimmed once read.
+  auto it = StateForModel()->StaticOutputDims().find(name);
+  if ((it == StateForModel()->StaticOutputDims().end()) ||
+      (scalar_outputs_.count(name) != 0) ||
+      (StateForModel()->ShapeBucketOutputs().count(name) != 0)) {
+    return nullptr;  // allocated by ORT
+  }
+
+  std::vector<int64_t> shape;
+  if (model_state_->MaxBatchSize() > 0) {
+    shape.push_back(ctx->total_batch_size);
+  }
+  shape.insert(shape.end(), it->second.begin(), it->second.end());
+  if (info.dims_.size() != shape.size()) {
+    return nullptr;  // allocated by ORT
+  }
+  for (size_t idx = 0; idx < shape.size(); idx++) {
+    if ((info.dims_[idx] >= 0) && (info.dims_[idx] != shape[idx])) {
+      return nullptr;  // allocated by ORT
+    }
+  }
+
+  return GetCachedTensor(
+      ctx, &ctx->cached_outputs[name], name.c_str(),
+      ConvertFromOnnxDataType(info.type_), shape,
+      memory_type != TRITONSERVER_MEMORY_GPU /* on_cpu */, tensor);
+}
+
+TRITONSERVER_Error*
+ModelInstanceState::SetOutputTensors(ExecutionContext* ctx)
+{
+  // Set preferred memory type and id. This will be used while querying
+  // memory type to be used for output buffer.
+  TRITONSERVER_MemoryType preferred_memory_type = TRITONSERVER_MEMORY_CPU;
+  int64_t preferred_memory_type_id = 0;
+  if (Kind() == TRITONSERVER_INSTANCEGROUPKIND_GPU) {
+    preferred_memory_type = TRITONSERVER_MEMORY_GPU;
+    preferred_memory_type_id = DeviceId();
+  }
+
+  // Collect the outputs requested by any request of the batch, so that
+  // the session doesn't compute the others.
+  std::set<std::string> requested_outputs;
+  for (size_t ridx = 0; ridx < ctx->requests.size(); ridx++) {
+    uint32_t requested_output_count;
+    RETURN_IF_ERROR(TRITONBACKEND_RequestOutputCount(
+        ctx->requests[ridx], &requested_output_count));
+    for (uint32_t idx = 0; idx < requested_output_count; idx++) {
+      const char* requested_output_name;
+      RETURN_IF_ERROR(TRITONBACKEND_RequestOutputName(
+          ctx->requests[ridx], idx, &requested_output_name));
+      requested_outputs.insert(requested_output_name);
+    }
+  }
+
+  // The outputs of a single-request batch can be written directly into
+  // its response when their shape is known ahead of the run.
+  std::set<std::string> zero_copy_outputs;
+  if (StateForModel()->EnableZeroCopyOutput() &&
+      (ctx->io_binding != nullptr) && (ctx->requests.size() == 1) &&
+      (ctx->responses[0] != nullptr)) {
+    for (const auto& name : requested_outputs) {
+      if ((StateForModel()->StaticOutputDims().count(name) != 0) &&
+          (scalar_outputs_.count(name) == 0)) {
+        zero_copy_outputs.insert(name);
       }
     }
-    ModelInstanceState* ctx_;
-  } io_tensor_wrapper(this);
+  }
+
+  // Request to retrieve the requested model outputs and the output
+  // states, which must be updated regardless of the requested outputs.
+  // 'output_names' and 'output_tensors' are parallel vectors and so must
+  // be kept in sync. The outputs whose shape is known are written into
+  // cached tensors, which are only handed to the run if all the outputs
+  // are, so that ORT doesn't allocate them.
+  std::vector<OrtValue*> cached_tensors;
+  bool all_cached = true;
+  for (auto& output_name : StateForModel()->ModelOutputs()) {
+    if ((output_name.second.second == -1) &&
+        (requested_outputs.count(output_name.first) == 0)) {
+      continue;
+    }
+    ctx->output_names.emplace_back(output_name.first.c_str());
+    ctx->output_tensors.emplace_back(nullptr);
+    cached_tensors.emplace_back(nullptr);
+
+    TRITONSERVER_MemoryType memory_type = TRITONSERVER_MEMORY_CPU;
+    int64_t memory_type_id = 0;
+
+    // Get data type for this output. If this is a string then
+    // use CPU for binding output otherwise, query the preferred location
+    // for this output and bind accordingly. In case of any errors we
+    // fallback to binding the output to CPU.
+    auto iit = output_tensor_infos_.find(output_name.first);
+    if (iit == output_tensor_infos_.end()) {
+      LOG_MESSAGE(
+          TRITONSERVER_LOG_VERBOSE,
+          (std::string(
+               "Error while retrieving output data type. Using cpu "
+               "as preferred location for output: " +
+               output_name.first)
+               .c_str()));
+    } else if (iit->second.type_ != ONNX_TENSOR_ELEMENT_DATA_TYPE_STRING) {
+      // Query the memory type of destination output buffer. Bind the
+      // output to this destination memory type. The destination memory type
+      // for an output for all requests should be same. So use any request
+      // for this query.
+      memory_type = preferred_memory_type;
+      memory_type_id = preferred_memory_type_id;
+      auto err = TRITONBACKEND_RequestOutputBufferProperties(
+          ctx->requests[0], output_name.first.c_str(), /*byte_size*/ nullptr,
+          &memory_type, &memory_type_id);
 
-  std::vector<const char*> input_names;
-  bool cuda_copy = false;
-  BackendInputCollector collector(
-      requests, request_count, &responses, model_state_->TritonMemoryManager(),
-      model_state_->EnablePinnedInput(), CudaStream(), nullptr, nullptr, 0,
-      HostPolicyName().c_str());
-  RESPOND_ALL_AND_SET_TRUE_IF_ERROR(
-      responses, request_count, all_response_failed,
-      SetInputTensors(
-          total_batch_size, requests, request_count, &responses, &collector,
-          &input_names, &cuda_copy));
-
-  if (!all_response_failed) {
-    // Set preferred memory type and id. This will be used while querying
-    // memory type to be used for output buffer.
-    TRITONSERVER_MemoryType preferred_memory_type = TRITONSERVER_MEMORY_CPU;
-    int64_t preferred_memory_type_id = 0;
-    if (Kind() == TRITONSERVER_INSTANCEGROUPKIND_GPU) {
-      preferred_memory_type = TRITONSERVER_MEMORY_GPU;
-      preferred_memory_type_id = DeviceId();
-    }
-
-    // Request to retrieve all model outputs. 'output_names' and
-    // 'output_tensors_' are parallel vectors and so must be kept in
-    // sync. [TODO] should collect only the outputs needed by some
-    // request.
-    for (auto& output_name : StateForModel()->ModelOutputs()) {
-      output_tensors_.emplace_back(nullptr);
-
-      TRITONSERVER_MemoryType memory_type = TRITONSERVER_MEMORY_CPU;
-      int64_t memory_type_id = 0;
-
-      // Get data type for this output. If this is a string then
-      // use CPU for binding output otherwise, query the preferred location
-      // for this output and bind accordingly. In case of any errors we
-      // fallback to binding the output to CPU.
-      auto iit = output_tensor_infos_.find(output_name.first);
-      if (iit == output_tensor_infos_.end()) {
+      if (err != nullptr) {
         LOG_MESSAGE(
             TRITONSERVER_LOG_VERBOSE,
             (std::string(
-                 "Error while retrieving output data type. Using cpu "
-                 "as preferred location for output: " +
-                 output_name.first)
+                 "Output Properties Unavailable. Using cpu as "
+                 "preferred location for output: " +
+                 output_name.first +
+                 " Error: " + TRITONSERVER_ErrorMessage(err))
                  .c_str()));
-      } else if (iit->second.type_ != ONNX_TENSOR_ELEMENT_DATA_TYPE_STRING) {
-        // Query the memory type of destination output buffer. Bind the
-        // output to this destination memory type. The destination memory type
-        // for an output for all requests should be same. So use any request
-        // for this query.
-        memory_type = preferred_memory_type;
-        memory_type_id = preferred_memory_type_id;
-        auto err = TRITONBACKEND_RequestOutputBufferProperties(
-            requests[0], output_name.first.c_str(), /*byte_size*/ nullptr,
-            &memory_type, &memory_type_id);
-
-        if (err != nullptr) {
-          LOG_MESSAGE(
-              TRITONSERVER_LOG_VERBOSE,
-              (std::string(
-                   "Output Properties Unavailable. Using cpu as "
-                   "preferred location for output: " +
-                   output_name.first +
-                   " Error: " + TRITONSERVER_ErrorMessage(err))
-                   .c_str()));
-          memory_type = TRITONSERVER_MEMORY_CPU;
-          memory_type_id = 0;
-        }
-      }
-
-      // If the cuda allocator is not set, bind the output to CPU.
-      if (cuda_allocator_info_ == nullptr) {
+        TRITONSERVER_ErrorDelete(err);
         memory_type = TRITONSERVER_MEMORY_CPU;
         memory_type_id = 0;
       }
-
-      // finally save the derived mem type and device id as we need it for
-      // reading the outputs.
-      output_device_info_[output_name.first] = {memory_type, memory_type_id};
-
-      RESPOND_ALL_AND_SET_TRUE_IF_ORT_ERROR(
-          responses, request_count, all_response_failed,
-          ort_api->BindOutputToDevice(
-              io_binding_, output_name.first.c_str(),
-              memory_type == TRITONSERVER_MEMORY_GPU ? cuda_allocator_info_
-                                                     : cpu_allocator_info_));
     }
-  }
-
-  // Wait for any in-flight input tensor copies to complete.
-#ifdef TRITON_ENABLE_GPU
-  if (cuda_copy) {
-    cudaStreamSynchronize(CudaStream());
-  }
-#endif
-
-  uint64_t compute_start_ns = 0;
-  SET_TIMESTAMP(compute_start_ns);
-
-  if (!all_response_failed) {
-    RESPOND_ALL_AND_SET_TRUE_IF_ERROR(
-        responses, request_count, all_response_failed,
-        OrtRun(&responses, request_count));
-  }
-
-  uint64_t compute_end_ns = 0;
-  SET_TIMESTAMP(compute_end_ns);
-
-  if (!all_response_failed) {
-    RESPOND_ALL_AND_SET_TRUE_IF_ERROR(
-        responses, request_count, all_response_failed,
-        ReadOutputTensors(
-            total_batch_size, requests, request_count, &responses));
-  }
 
-  uint64_t exec_end_ns = 0;
-  SET_TIMESTAMP(exec_end_ns);
+    // If the cuda allocator is not set, bind the output to CPU. The
+    // outputs of an asynchronous run are always allocated by ORT on CPU,
+    // and the bucketed outputs are trimmed on CPU.
+    if ((cuda_allocator_info_ == nullptr) || (ctx->io_binding == nullptr) ||
+        (StateForModel()->ShapeBucketOutputs().count(output_name.first) !=
+         0)) {
+      memory_type = TRITONSERVER_MEMORY_CPU;
+      memory_type_id = 0;
+    }
 
-  // Send all the responses that haven't already been sent because of
-  // an earlier error. Note that the responses are not set to nullptr
-  // here as we need that indication below to determine if the request
-  // we successful or not.
-  for (auto& response : responses) {
-    if (response != nullptr) {
-      LOG_IF_ERROR(
-          TRITONBACKEND_ResponseSend(
-              response, TRITONSERVER_RESPONSE_COMPLETE_FINAL, nullptr),
-          "failed to send onnxruntime backend response");
+    // finally save the derived mem type and device id as we need it for
+    // reading the outputs.
+    ctx->output_device_info[output_name.first] = {memory_type, memory_type_id};
+
+    if ((zero_copy_outputs.count(output_name.first) != 0) &&
+        (iit != output_tensor_infos_.end())) {
+      bool bound = false;
+      RETURN_IF_ERROR(BindResponseBuffer(
+          ctx, output_name.first, iit->second.type_, memory_type,
+          memory_type_id, &bound));
+      if (bound) {
+        continue;
+      }
     }
-  }
 
-  // Report statistics for each request.
-  for (uint32_t r = 0; r < request_count; ++r) {
-    auto& request = requests[r];
-    LOG_IF_ERROR(
-        TRITONBACKEND_ModelInstanceReportStatistics(
-            TritonModelInstance(), request,
-            (responses[r] != nullptr) /* success */, exec_start_ns,
-            compute_start_ns, compute_end_ns, exec_end_ns),
-        "failed reporting request statistics");
+    if (iit != output_tensor_infos_.end()) {
+      RETURN_IF_ERROR(GetCachedOutputTensor(
+          ctx, output_name.first, iit->second, memory_type,
+          &cached_tensors.back()));
+    }
+    if (cached_tensors.back() == nullptr) {
+      all_cached = false;
+      if (ctx->io_binding != nullptr) {
+        RETURN_IF_ORT_ERROR(ort_api->BindOutputToDevice(
+            ctx->io_binding, output_name.first.c_str(),
+            memory_type == TRITONSERVER_MEMORY_GPU ? cuda_allocator_info_
+                                                   : cpu_allocator_info_));
+      }
+      continue;
+    }
 
-    LOG_IF_ERROR(
-        TRITONBACKEND_RequestRelease(request, TRITONSERVER_REQUEST_RELEASE_ALL),
-        "failed releasing request");
+    // The buffer may not be in the preferred memory.
+    const BackendMemory* memory =
+        ctx->cached_outputs[output_name.first].memory.get();
+    ctx->output_device_info[output_name.first] = {
+        memory->MemoryType(), memory->MemoryTypeId()};
+    if (ctx->io_binding != nullptr) {
+      RETURN_IF_ORT_ERROR(ort_api->BindOutput(
+          ctx->io_binding, output_name.first.c_str(),
+          cached_tensors.back()));
+    }
   }
 
-  if (!all_response_failed) {
-    // Report the entire batch statistics.
-    LOG_IF_ERROR(
-        TRITONBACKEND_ModelInstanceReportBatchStatistics(
-            TritonModelInstance(), total_batch_size, exec_start_ns,
-            compute_start_ns, compute_end_ns, exec_end_ns),
-        "failed reporting batch request statistics");
+  if (all_cached) {
+    ctx->output_tensors = cached_tensors;
+    ctx->output_tensors_owned = false;
   }
-}
 
-TRITONSERVER_Error*
-ModelInstanceState::OrtRun(
-    std::vector<TRITONBACKEND_Response*>* responses,
-    const uint32_t response_count)
-{
-  RETURN_IF_ORT_ERROR(
-      ort_api->RunWithBinding(session_, runOptions_, io_binding_));
-  return nullptr;
+  return nullptr;  // success
 }
 
 TRITONSERVER_Error*
-ModelInstanceState::SetInputTensors(
-    size_t total_batch_size, TRITONBACKEND_Request** requests,
-    const uint32_t request_count,
-    std::vector<TRITONBACKEND_Response*>* responses,
-    BackendInputCollector* collector, std::vector<const char*>* input_names,
-    bool* cuda_copy)
+ModelInstanceState::SetInputTensors(ExecutionContext* ctx, bool* cuda_copy)
 {
   const int max_batch_size = model_state_->MaxBatchSize();
+  const size_t total_batch_size = ctx->total_batch_size;
+  TRITONBACKEND_Request** requests = ctx->requests.data();
+  const uint32_t request_count = ctx->requests.size();
+  std::vector<TRITONBACKEND_Response*>* responses = &ctx->responses;
+  BackendInputCollector* collector = &*ctx->collector;
+  std::vector<const char*>* input_names = &ctx->input_names;
+  std::vector<OrtValue*>& input_tensors = ctx->input_tensors;
+  std::vector<PendingPad> pending_pads;
 
   // All requests must have equally-sized input tensors so use any
   // request as the representative for the input tensors.
@@ -2194,7 +5603,7 @@ ModelInstanceState::SetInputTensors(
         nullptr, nullptr));
 
     input_names->emplace_back(input_name);
-    input_tensors_.emplace_back(nullptr);
+    input_tensors.emplace_back(nullptr);
 
     std::vector<int64_t> batchn_shape;
     // For a ragged input tensor, the tensor shape should be
@@ -2226,29 +5635,6 @@ ModelInstanceState::SetInputTensors(
     }
 
     if (input_datatype != TRITONSERVER_TYPE_BYTES) {
-      // The input must be in contiguous CPU memory. Use appropriate
-      // allocator info to bind inputs to the right device. .i.e bind inputs
-      // to GPU if they are being provided on GPU.
-      const char* input_buffer;
-      size_t batchn_byte_size;
-      TRITONSERVER_MemoryType memory_type;
-      int64_t memory_type_id;
-      std::vector<std::pair<TRITONSERVER_MemoryType, int64_t>>
-          allowed_input_types;
-      if (Kind() == TRITONSERVER_INSTANCEGROUPKIND_GPU) {
-        allowed_input_types = {
-            {TRITONSERVER_MEMORY_GPU, DeviceId()},
-            {TRITONSERVER_MEMORY_CPU_PINNED, 0},
-            {TRITONSERVER_MEMORY_CPU, 0}};
-      } else {
-        allowed_input_types = {
-            {TRITONSERVER_MEMORY_CPU_PINNED, 0}, {TRITONSERVER_MEMORY_CPU, 0}};
-      }
-
-      RETURN_IF_ERROR(collector->ProcessTensor(
-          input_name, nullptr, 0, allowed_input_types, &input_buffer,
-          &batchn_byte_size, &memory_type, &memory_type_id));
-
       auto iti = input_tensor_infos_.find(input_name);
       if (iti == input_tensor_infos_.end()) {
         return TRITONSERVER_ErrorNew(
@@ -2259,26 +5645,37 @@ ModelInstanceState::SetInputTensors(
                 input_name + "'.")
                 .c_str());
       }
-
-      // Create ORT Tensor
+      // scalar tensor
       if (iti->second.dims_.size() == 0) {
-        // scalar tensor
-        RETURN_IF_ORT_ERROR(ort_api->CreateTensorWithDataAsOrtValue(
-            memory_type == TRITONSERVER_MEMORY_GPU ? cuda_allocator_info_
-                                                   : cpu_allocator_info_,
-            (void*)input_buffer, batchn_byte_size, nullptr /* scalar */,
-            0 /* number of dims */, ConvertToOnnxDataType(input_datatype),
-            &input_tensors_.back()));
+        batchn_shape.clear();
+      }
+
+      // Bucketed inputs are padded up to the bucket of the batch and only
+      // bound once padded. Otherwise the input of a single request is
+      // used in place when possible, the inputs of several requests are
+      // gathered into the staging buffer of the context, whose tensors
+      // are kept for the next runs of the same shape.
+      auto bucket_it = StateForModel()->ShapeBucketInputs().find(input_name);
+      bool bind_input = true;
+      if (bucket_it != StateForModel()->ShapeBucketInputs().end()) {
+        const size_t pending_pad_cnt = pending_pads.size();
+        RETURN_IF_ERROR(SetBucketedInputTensor(
+            ctx, input_name, input_datatype, batchn_shape, bucket_it->second,
+            &input_tensors.back(), &pending_pads));
+        bind_input = (pending_pads.size() == pending_pad_cnt);
+      } else if (request_count == 1) {
+        RETURN_IF_ERROR(SetRequestInputTensor(
+            ctx, input_name, input_datatype, batchn_shape,
+            &input_tensors.back()));
       } else {
-        RETURN_IF_ORT_ERROR(ort_api->CreateTensorWithDataAsOrtValue(
-            memory_type == TRITONSERVER_MEMORY_GPU ? cuda_allocator_info_
-                                                   : cpu_allocator_info_,
-            (void*)input_buffer, batchn_byte_size, batchn_shape.data(),
-            batchn_shape.size(), ConvertToOnnxDataType(input_datatype),
-            &input_tensors_.back()));
+        RETURN_IF_ERROR(SetCachedInputTensor(
+            ctx, input_name, input_datatype, batchn_shape,
+            &input_tensors.back()));
+      }
+      if (bind_input && (ctx->io_binding != nullptr)) {
+        RETURN_IF_ORT_ERROR(ort_api->BindInput(
+            ctx->io_binding, input_name, input_tensors.back()));
       }
-      RETURN_IF_ORT_ERROR(
-          ort_api->BindInput(io_binding_, input_name, input_tensors_.back()));
     } else {
       // For BYTES input, we need to convert the serialized string
       // representation into what is required for ORT. ORT expects a
@@ -2288,22 +5685,28 @@ ModelInstanceState::SetInputTensors(
       // <int32_len><bytes><int32_len><bytes>... serialization into a
       // <bytes><null-terminator><bytes><null-terminator>... serialization
       // and then initialize 'string_ptrs' to point to each <bytes>.
-      std::vector<const char*> string_ptrs;
+      std::vector<const char*>& string_ptrs = ctx->string_ptrs;
+      string_ptrs.clear();
 
       SetStringInputTensor(
-          requests, request_count, responses, input_name, &string_ptrs,
+          ctx, requests, request_count, responses, input_name, &string_ptrs,
           cuda_copy);
 
-      RETURN_IF_ORT_ERROR(ort_api->CreateTensorAsOrtValue(
-          default_allocator_, batchn_shape.data(), batchn_shape.size(),
-          ONNX_TENSOR_ELEMENT_DATA_TYPE_STRING, &input_tensors_.back()));
+      RETURN_IF_ERROR(GetCachedStringTensor(
+          ctx, input_name, batchn_shape, &input_tensors.back()));
       RETURN_IF_ORT_ERROR(ort_api->FillStringTensor(
-          input_tensors_.back(), string_ptrs.data(), string_ptrs.size()));
-      RETURN_IF_ORT_ERROR(
-          ort_api->BindInput(io_binding_, input_name, input_tensors_.back()));
+          input_tensors.back(), string_ptrs.data(), string_ptrs.size()));
+      if (ctx->io_binding != nullptr) {
+        RETURN_IF_ORT_ERROR(ort_api->BindInput(
+            ctx->io_binding, input_name, input_tensors.back()));
+      }
     }
   }
 
+  if (!StateForModel()->ShapeBucketMaskInput().empty()) {
+    RETURN_IF_ERROR(SetShapeBucketMaskTensor(ctx));
+  }
+
   // Process batch input if any
   for (const auto& batch_input : StateForModel()->BatchInputs()) {
     std::vector<int64_t> shape;
@@ -2311,41 +5714,350 @@ ModelInstanceState::SetInputTensors(
 
     for (const auto& input_name : batch_input.TargetNames()) {
       input_names->emplace_back(input_name.c_str());
-      input_tensors_.emplace_back(nullptr);
+      input_tensors.emplace_back(nullptr);
 
       const char* dst_buffer;
       size_t dst_buffer_byte_size;
       TRITONSERVER_MemoryType dst_memory_type;
       int64_t dst_memory_type_id;
 
-      // Batch inputs are always created on CPU
+      // Batch inputs are always created on CPU, in the staging buffer of
+      // the target input.
+      ExecutionContext::CachedTensor* cached =
+          &ctx->cached_inputs[input_name];
+      RETURN_IF_ERROR(GetCachedTensor(
+          ctx, cached, input_name.c_str(), batch_input.DataType(), shape,
+          true /* on_cpu */, &input_tensors.back()));
       RESPOND_ALL_AND_SET_NULL_IF_ERROR(
           (*responses), responses->size(),
           collector->ProcessBatchInput(
-              batch_input, nullptr, 0, {{TRITONSERVER_MEMORY_CPU, 0}},
+              batch_input, cached->memory->MemoryPtr(),
+              GetByteSize(batch_input.DataType(), shape),
+              {{cached->memory->MemoryType(), cached->memory->MemoryTypeId()}},
               &dst_buffer, &dst_buffer_byte_size, &dst_memory_type,
               &dst_memory_type_id));
 
-      // Create ORT Tensor
-      RETURN_IF_ORT_ERROR(ort_api->CreateTensorWithDataAsOrtValue(
-          cpu_allocator_info_, (void*)dst_buffer, dst_buffer_byte_size,
-          shape.data(), shape.size(),
-          ConvertToOnnxDataType(batch_input.DataType()),
-          &input_tensors_.back()));
-
-      RETURN_IF_ORT_ERROR(ort_api->BindInput(
-          io_binding_, input_name.c_str(), input_tensors_.back()));
+      if (ctx->io_binding != nullptr) {
+        RETURN_IF_ORT_ERROR(ort_api->BindInput(
+            ctx->io_binding, input_name.c_str(), input_tensors.back()));
+      }
     }
   }
 
   // Finalize...
   *cuda_copy |= collector->Finalize();
+
+  // The bucketed inputs can only be padded once gathered.
+  if (!pending_pads.empty()) {
+#ifdef TRITON_ENABLE_GPU
+    if (*cuda_copy) {
+      cudaStreamSynchronize(CudaStream());
+      *cuda_copy = false;
+    }
+#endif  // TRITON_ENABLE_GPU
+    RETURN_IF_ERROR(PadInputTensors(ctx, pending_pads));
+  }
   return nullptr;
 }
 
+TRITONSERVER_Error*
+ModelInstanceState::GetCachedTensor(
+    ExecutionContext* ctx, ExecutionContext::CachedTensor* cached,
+    const char* name, const TRITONSERVER_DataType datatype,
+    const std::vector<int64_t>& shape, const bool on_cpu, OrtValue** tensor)
+{
+  const int64_t byte_size = GetByteSize(datatype, shape);
+  if (byte_size < 0) {
+    return TRITONSERVER_ErrorNew(
+        TRITONSERVER_ERROR_INVALID_ARG,
+        (std::string("unable to determine the byte size of tensor '") + name +
+         "'")
+            .c_str());
+  }
+
+  // The buffer only grows, the tensors wrapping the previous buffer are
+  // dropped when it does.
+  if ((cached->memory == nullptr) ||
+      (cached->memory->ByteSize() < (size_t)byte_size)) {
+    cached->tensors.clear();
+    cached->memory.reset();
+    std::vector<BackendMemory::AllocationType> alloc_types;
+    int64_t memory_type_id = 0;
+    if (!on_cpu && (Kind() == TRITONSERVER_INSTANCEGROUPKIND_GPU)) {
+      alloc_types = {BackendMemory::AllocationType::GPU};
+      memory_type_id = DeviceId();
+    }
+    if (model_state_->EnablePinnedInput()) {
+      alloc_types.push_back(BackendMemory::AllocationType::CPU_PINNED);
+    }
+    alloc_types.push_back(BackendMemory::AllocationType::CPU);
+    BackendMemory* memory;
+    RETURN_IF_ERROR(BackendMemory::Create(
+        model_state_->TritonMemoryManager(), alloc_types, memory_type_id,
+        byte_size, &memory));
+    cached->memory.reset(memory);
+    ctx->run_allocation_cnt++;
+  }
+
+  auto it = cached->tensors.find(shape);
+  if (it == cached->tensors.end()) {
+    if (cached->tensors.size() >= kMaxCachedShapeCnt) {
+      cached->tensors.clear();
+    }
+    OrtValue* cached_tensor;
+    RETURN_IF_ORT_ERROR(ort_api->CreateTensorWithDataAsOrtValue(
+        cached->memory->MemoryType() == TRITONSERVER_MEMORY_GPU
+            ? cuda_allocator_info_
+            : cpu_allocator_info_,
+        cached->memory->MemoryPtr(), byte_size, shape.data(), shape.size(),
+        ConvertToOnnxDataType(datatype), &cached_tensor));
+    it = cached->tensors.emplace(shape, cached_tensor).first;
+    ctx->run_allocation_cnt++;
+  }
+  *tensor = it->second.get();
+
+  return nullptr;  // success
+}
+
+TRITONSERVER_Error*
+ModelInstanceState::GetCachedStringTensor(
+    ExecutionContext* ctx, const char* name, const std::vector<int64_t>& shape,
+    OrtValue** tensor)
+{
+  ExecutionContext::CachedTensor& cached = ctx->cached_inputs[name];
+  auto it = cached.tensors.find(shape);
+  if (it == cached.tensors.end()) {
+    if (cached.tensors.size() >= kMaxCachedShapeCnt) {
+      cached.tensors.clear();
+    }
+    OrtValue* cached_tensor;
+    RETURN_IF_ORT_ERROR(ort_api->CreateTensorAsOrtValue(
+        default_allocator_, shape.data(), shape.size(),
+        ONNX_TENSOR_ELEMENT_DATA_TYPE_STRING, &cached_tensor));
+    it = cached.tensors.emplace(shape, cached_tensor).first;
+    ctx->run_allocation_cnt++;
+  }
+  *tensor = it->second.get();
+
+  return nullptr;  // success
+}
+
+TRITONSERVER_Error*
+ModelInstanceState::SetRequestInputTensor(
+    ExecutionContext* ctx, const char* name,
+    const TRITONSERVER_DataType datatype, const std::vector<int64_t>& shape,
+    OrtValue** tensor)
+{
+  // Bind the input to GPU if it is provided on GPU.
+  std::vector<std::pair<TRITONSERVER_MemoryType, int64_t>> allowed_input_types;
+  if (Kind() == TRITONSERVER_INSTANCEGROUPKIND_GPU) {
+    allowed_input_types = {
+        {TRITONSERVER_MEMORY_GPU, DeviceId()},
+        {TRITONSERVER_MEMORY_CPU_PINNED, 0},
+        {TRITONSERVER_MEMORY_CPU, 0}};
+  } else {
+    allowed_input_types = {
+        {TRITONSERVER_MEMORY_CPU_PINNED, 0}, {TRITONSERVER_MEMORY_CPU, 0}};
+  }
+  const char* buffer;
+  size_t byte_size;
+  TRITONSERVER_MemoryType memory_type;
+  int64_t memory_type_id;
+  RETURN_IF_ERROR(ctx->collector->ProcessTensor(
+      name, nullptr, 0, allowed_input_types, &buffer, &byte_size,
+      &memory_type, &memory_type_id));
+
+  // ORT can't point a tensor to another buffer, so the wrapper is created
+  // for each run.
+  RETURN_IF_ORT_ERROR(ort_api->CreateTensorWithDataAsOrtValue(
+      memory_type == TRITONSERVER_MEMORY_GPU ? cuda_allocator_info_
+                                             : cpu_allocator_info_,
+      (void*)buffer, byte_size, shape.data(), shape.size(),
+      ConvertToOnnxDataType(datatype), tensor));
+  ctx->run_input_tensors.emplace_back(*tensor);
+  ctx->run_allocation_cnt++;
+
+  return nullptr;  // success
+}
+
+TRITONSERVER_Error*
+ModelInstanceState::SetCachedInputTensor(
+    ExecutionContext* ctx, const char* name,
+    const TRITONSERVER_DataType datatype, const std::vector<int64_t>& shape,
+    OrtValue** tensor)
+{
+  ExecutionContext::CachedTensor* cached = &ctx->cached_inputs[name];
+  RETURN_IF_ERROR(GetCachedTensor(
+      ctx, cached, name, datatype, shape, false /* on_cpu */, tensor));
+
+  BackendMemory* memory = cached->memory.get();
+  const char* buffer;
+  size_t buffer_byte_size;
+  TRITONSERVER_MemoryType memory_type;
+  int64_t memory_type_id;
+  RETURN_IF_ERROR(ctx->collector->ProcessTensor(
+      name, memory->MemoryPtr(), GetByteSize(datatype, shape),
+      {{memory->MemoryType(), memory->MemoryTypeId()}}, &buffer,
+      &buffer_byte_size, &memory_type, &memory_type_id));
+
+  return nullptr;  // success
+}
+
+TRITONSERVER_Error*
+ModelInstanceState::SetBucketedInputTensor(
+    ExecutionContext* ctx, const char* name,
+    const TRITONSERVER_DataType datatype, const std::vector<int64_t>& shape,
+    const size_t dim, OrtValue** tensor, std::vector<PendingPad>* pending_pads)
+{
+  if (dim >= shape.size()) {
+    return TRITONSERVER_ErrorNew(
+        TRITONSERVER_ERROR_INTERNAL,
+        (std::string("unexpected shape ") + ShapeToString(shape) +
+         " for bucketed input '" + name + "'")
+            .c_str());
+  }
+  const int64_t size = shape[dim];
+  if (ctx->bucket_size < 0) {
+    ctx->bucket_length = size;
+    ctx->bucket_size = StateForModel()->ShapeBucketFor(size);
+  } else if (size != ctx->bucket_length) {
+    return TRITONSERVER_ErrorNew(
+        TRITONSERVER_ERROR_INVALID_ARG,
+        (std::string("bucketed input '") + name + "' has size " +
+         std::to_string(size) + ", expected the size " +
+         std::to_string(ctx->bucket_length) +
+         " of the other bucketed inputs")
+            .c_str());
+  }
+
+  // The input is padded by the CPU so it must be in CPU memory. The
+  // input of a single request is used in place when possible, the
+  // inputs of several requests are gathered into the staging buffer.
+  OrtValue* gathered = nullptr;
+  const char* buffer;
+  size_t byte_size;
+  TRITONSERVER_MemoryType memory_type;
+  int64_t memory_type_id;
+  if (ctx->requests.size() == 1) {
+    RETURN_IF_ERROR(ctx->collector->ProcessTensor(
+        name, nullptr, 0,
+        {{TRITONSERVER_MEMORY_CPU_PINNED, 0}, {TRITONSERVER_MEMORY_CPU, 0}},
+        &buffer, &byte_size, &memory_type, &memory_type_id));
+  } else {
+    ExecutionContext::CachedTensor* cached = &ctx->cached_inputs[name];
+    RETURN_IF_ERROR(GetCachedTensor(
+        ctx, cached, name, datatype, shape, true /* on_cpu */, &gathered));
+    RETURN_IF_ERROR(ctx->collector->ProcessTensor(
+        name, cached->memory->MemoryPtr(), GetByteSize(datatype, shape),
+        {{cached->memory->MemoryType(), cached->memory->MemoryTypeId()}},
+        &buffer, &byte_size, &memory_type, &memory_type_id));
+  }
+
+  if (ctx->bucket_size == size) {
+    if (gathered == nullptr) {
+      RETURN_IF_ORT_ERROR(ort_api->CreateTensorWithDataAsOrtValue(
+          cpu_allocator_info_, (void*)buffer, byte_size, shape.data(),
+          shape.size(), ConvertToOnnxDataType(datatype), &gathered));
+      ctx->run_input_tensors.emplace_back(gathered);
+      ctx->run_allocation_cnt++;
+    }
+    *tensor = gathered;
+    return nullptr;  // success
+  }
+
+  std::vector<int64_t> padded_shape = shape;
+  padded_shape[dim] = ctx->bucket_size;
+  RETURN_IF_ERROR(GetCachedTensor(
+      ctx, &ctx->padded_inputs[name], name, datatype, padded_shape,
+      true /* on_cpu */, tensor));
+  pending_pads->push_back({name, datatype, buffer, shape, dim, *tensor});
+
+  return nullptr;  // success
+}
+
+TRITONSERVER_Error*
+ModelInstanceState::PadInputTensors(
+    ExecutionContext* ctx, const std::vector<PendingPad>& pending_pads)
+{
+  for (const auto& pad : pending_pads) {
+    char pad_element[16];
+    RETURN_IF_ERROR(FillElements(
+        pad.datatype, StateForModel()->ShapeBucketPadValue(), 1,
+        pad_element));
+    char* dst;
+    RETURN_IF_ORT_ERROR(
+        ort_api->GetTensorMutableData(pad.tensor, (void**)&dst));
+    PadDimension(
+        pad.src, pad.shape, pad.dim, ctx->bucket_size,
+        TRITONSERVER_DataTypeByteSize(pad.datatype), pad_element, dst);
+    if (ctx->io_binding != nullptr) {
+      RETURN_IF_ORT_ERROR(
+          ort_api->BindInput(ctx->io_binding, pad.name, pad.tensor));
+    }
+  }
+
+  return nullptr;  // success
+}
+
+TRITONSERVER_Error*
+ModelInstanceState::SetShapeBucketMaskTensor(ExecutionContext* ctx)
+{
+  const std::string& name = StateForModel()->ShapeBucketMaskInput();
+  if (ctx->bucket_size < 0) {
+    return TRITONSERVER_ErrorNew(
+        TRITONSERVER_ERROR_INVALID_ARG,
+        (std::string("unable to generate input '") + name +
+         "' without the bucketed inputs")
+            .c_str());
+  }
+  auto iti = input_tensor_infos_.find(name);
+  if (iti == input_tensor_infos_.end()) {
+    return TRITONSERVER_ErrorNew(
+        TRITONSERVER_ERROR_INTERNAL,
+        (std::string("Failed to retrieve the ONNX input tensor info from '") +
+         name + "'.")
+            .c_str());
+  }
+
+  // 1 for the elements of the requests and 0 for the padding, for each
+  // batch entry.
+  const TRITONSERVER_DataType datatype =
+      ConvertFromOnnxDataType(iti->second.type_);
+  std::vector<int64_t> shape{ctx->bucket_size};
+  int64_t row_cnt = 1;
+  if (model_state_->MaxBatchSize() > 0) {
+    row_cnt = ctx->total_batch_size;
+    shape.insert(shape.begin(), row_cnt);
+  }
+  OrtValue* tensor;
+  RETURN_IF_ERROR(GetCachedTensor(
+      ctx, &ctx->cached_inputs[name], name.c_str(), datatype, shape,
+      true /* on_cpu */, &tensor));
+  char* buffer;
+  RETURN_IF_ORT_ERROR(ort_api->GetTensorMutableData(tensor, (void**)&buffer));
+  const size_t element_byte_size = TRITONSERVER_DataTypeByteSize(datatype);
+  for (int64_t row = 0; row < row_cnt; row++) {
+    RETURN_IF_ERROR(FillElements(datatype, 1, ctx->bucket_length, buffer));
+    buffer += ctx->bucket_length * element_byte_size;
+    RETURN_IF_ERROR(FillElements(
+        datatype, 0, ctx->bucket_size - ctx->bucket_length, buffer));
+    buffer += (ctx->bucket_size - ctx->bucket_length) * element_byte_size;
+  }
+
+  ctx->input_names.emplace_back(name.c_str());
+  ctx->input_tensors.emplace_back(tensor);
+  if (ctx->io_binding != nullptr) {
+    RETURN_IF_ORT_ERROR(
+        ort_api->BindInput(ctx->io_binding, name.c_str(), tensor));
+  }
+
+  return nullptr;  // success
+}
+
 TRITONSERVER_Error*
 ModelInstanceState::SetStringInputTensor(
-    TRITONBACKEND_Request** requests, const uint32_t request_count,
+    ExecutionContext* ctx, TRITONBACKEND_Request** requests,
+    const uint32_t request_count,
     std::vector<TRITONBACKEND_Response*>* responses, const char* input_name,
     std::vector<const char*>* string_ptrs, bool* cuda_copy)
 {
@@ -2384,13 +6096,21 @@ ModelInstanceState::SetStringInputTensor(
   // expects elements to be C strings thus we need to modify input buffer.
   // Reserve one more byte at the end of input_buffer to ensure last
   // element of String data can become valid C string.
-  BackendMemory* input_memory;
-  RETURN_IF_ERROR(BackendMemory::Create(
-      model_state_->TritonMemoryManager(),
-      {BackendMemory::AllocationType::CPU_PINNED_POOL,
-       BackendMemory::AllocationType::CPU},
-      0 /* memory_type_id */, total_byte_size + 1, &input_memory));
-  input_tensor_memories_.push_back(input_memory);
+  // The buffer is kept for the next runs and only grows.
+  ExecutionContext::CachedTensor& cached = ctx->cached_inputs[input_name];
+  if ((cached.memory == nullptr) ||
+      (cached.memory->ByteSize() < total_byte_size + 1)) {
+    cached.memory.reset();
+    BackendMemory* memory;
+    RETURN_IF_ERROR(BackendMemory::Create(
+        model_state_->TritonMemoryManager(),
+        {BackendMemory::AllocationType::CPU_PINNED,
+         BackendMemory::AllocationType::CPU},
+        0 /* memory_type_id */, total_byte_size + 1, &memory));
+    cached.memory.reset(memory);
+    ctx->run_allocation_cnt++;
+  }
+  BackendMemory* input_memory = cached.memory.get();
 
   const TRITONSERVER_MemoryType mem_type = input_memory->MemoryType();
   char* input_buffer = input_memory->MemoryPtr();
@@ -2568,11 +6288,46 @@ ModelInstanceState::ReadOutputTensor(
 }
 
 TRITONSERVER_Error*
-ModelInstanceState::ReadOutputTensors(
-    size_t total_batch_size, TRITONBACKEND_Request** requests,
-    const uint32_t request_count,
-    std::vector<TRITONBACKEND_Response*>* responses)
+ModelInstanceState::CopyToResponseBuffer(
+    const std::string& name, OrtValue* output_tensor,
+    const std::pair<TRITONSERVER_MemoryType, int64_t>& tensor_memory,
+    const ExecutionContext::ResponseBuffer& buffer, bool* cuda_copy)
+{
+  std::vector<int64_t> batchn_shape;
+  TRITONSERVER_DataType dtype;
+  void* output_buffer;
+  std::vector<std::vector<char>> string_buffers;
+  std::vector<size_t> offsets;
+  RETURN_IF_ERROR(ReadOutputTensor(
+      batchn_shape, dtype, output_tensor, &output_buffer, string_buffers,
+      offsets));
+
+  const int64_t byte_size = GetByteSize(dtype, batchn_shape);
+  if ((byte_size < 0) || ((size_t)byte_size != buffer.byte_size)) {
+    return TRITONSERVER_ErrorNew(
+        TRITONSERVER_ERROR_INTERNAL,
+        (std::string("unexpected shape ") + ShapeToString(batchn_shape) +
+         " for output '" + name + "'")
+            .c_str());
+  }
+
+  bool cuda_used = false;
+  RETURN_IF_ERROR(CopyBuffer(
+      name, tensor_memory.first, tensor_memory.second, buffer.memory_type,
+      buffer.memory_type_id, buffer.byte_size, output_buffer, buffer.buffer,
+      CudaStream(), &cuda_used));
+  *cuda_copy |= cuda_used;
+
+  return nullptr;  // success
+}
+
+TRITONSERVER_Error*
+ModelInstanceState::ReadOutputTensors(ExecutionContext* ctx)
 {
+  TRITONBACKEND_Request** requests = ctx->requests.data();
+  const uint32_t request_count = ctx->requests.size();
+  std::vector<TRITONBACKEND_Response*>* responses = &ctx->responses;
+
   BackendOutputResponder responder(
       requests, request_count, responses, model_state_->TritonMemoryManager(),
       model_state_->MaxBatchSize() > 0, model_state_->EnablePinnedInput(),
@@ -2582,24 +6337,35 @@ ModelInstanceState::ReadOutputTensors(
   bool cuda_copy = false;
   auto& model_outputs = StateForModel()->ModelOutputs();
 
-  size_t output_count = 0;
-  RETURN_IF_ORT_ERROR(ort_api->GetBoundOutputValues(
-      io_binding_, default_allocator_, &output_buffer_, &output_count));
-  if (output_count != model_outputs.size()) {
+  // The outputs of an asynchronous run, and the outputs that are all
+  // written into cached tensors, are already in 'output_tensors'.
+  size_t output_count = ctx->output_tensors.size();
+  if ((ctx->io_binding != nullptr) && ctx->output_tensors_owned) {
+    RETURN_IF_ORT_ERROR(ort_api->GetBoundOutputValues(
+        ctx->io_binding, default_allocator_, &ctx->output_buffer,
+        &output_count));
+    ctx->run_allocation_cnt += output_count + 1;
+    // Hand the values over to 'output_tensors' so they are released
+    // with the other resources of the run.
+    for (size_t idx = 0;
+         idx < std::min(output_count, ctx->output_tensors.size()); idx++) {
+      ctx->output_tensors[idx] = ctx->output_buffer[idx];
+    }
+  }
+  if (output_count != ctx->output_names.size()) {
     RETURN_IF_ERROR(TRITONSERVER_ErrorNew(
         TRITONSERVER_ERROR_INTERNAL,
         ("Retrieved output count is not equal to expected count.")));
   }
 
   std::vector<std::vector<char>> string_buffers;
-  auto model_outputs_it = model_outputs.begin();
-  for (size_t idx = 0; idx < model_outputs.size(); idx++, model_outputs_it++) {
-    OrtValue* output_tensor = output_tensors_[idx] = output_buffer_[idx];
-    const std::string& name = model_outputs_it->first;
-    auto& output_tensor_pair = model_outputs_it->second;
-
-    auto output_device_info_iter = output_device_info_.find(name);
-    if (output_device_info_iter == output_device_info_.end()) {
+  for (size_t idx = 0; idx < ctx->output_names.size(); idx++) {
+    OrtValue* output_tensor = ctx->output_tensors[idx];
+    const std::string name = ctx->output_names[idx];
+    auto& output_tensor_pair = model_outputs.at(name);
+
+    auto output_device_info_iter = ctx->output_device_info.find(name);
+    if (output_device_info_iter == ctx->output_device_info.end()) {
       RETURN_IF_ERROR(TRITONSERVER_ErrorNew(
           TRITONSERVER_ERROR_INTERNAL,
           (std::string("device info for output tensor '") + name +
@@ -2609,6 +6375,20 @@ ModelInstanceState::ReadOutputTensors(
 
     const auto& alloc_perference = output_device_info_iter->second;
 
+    // The output is already in the response, or needs to be copied into
+    // the response buffer created for it.
+    auto response_buffer_it = ctx->response_buffers.find(name);
+    if (response_buffer_it != ctx->response_buffers.end()) {
+      if (!response_buffer_it->second.bound && (output_tensor != nullptr) &&
+          ((*responses)[0] != nullptr)) {
+        RESPOND_AND_SET_NULL_IF_ERROR(
+            &(*responses)[0], CopyToResponseBuffer(
+                                  name, output_tensor, alloc_perference,
+                                  response_buffer_it->second, &cuda_copy));
+      }
+      continue;
+    }
+
     const BatchOutput* batch_output = StateForModel()->FindBatchOutput(name);
     if (batch_output == nullptr) {
       if (output_tensor == nullptr) {
@@ -2644,6 +6424,20 @@ ModelInstanceState::ReadOutputTensors(
         batchn_shape = scalar_output_dims_it->second;
       }
 
+      // Trim the padding added by the shape bucketing.
+      auto bucket_it = StateForModel()->ShapeBucketOutputs().find(name);
+      if ((bucket_it != StateForModel()->ShapeBucketOutputs().end()) &&
+          (ctx->bucket_size > ctx->bucket_length) &&
+          (dtype != TRITONSERVER_TYPE_BYTES) &&
+          (bucket_it->second < batchn_shape.size()) &&
+          (batchn_shape[bucket_it->second] == ctx->bucket_size)) {
+        TrimDimension(
+            reinterpret_cast<char*>(output_buffer), batchn_shape,
+            bucket_it->second, ctx->bucket_length,
+            TRITONSERVER_DataTypeByteSize(dtype));
+        batchn_shape[bucket_it->second] = ctx->bucket_length;
+      }
+
       if (output_tensor_pair.first != -1) {
         if (dtype == TRITONSERVER_TYPE_BYTES) {
           auto content = string_buffers.back().data();
@@ -2944,11 +6738,110 @@ TRITONBACKEND_Initialize(TRITONBACKEND_Backend* backend)
       RETURN_IF_ERROR(ParseIntValue(value_str, &lvalue));
       lconfig->default_max_batch_size_ = lvalue;
     }
+    if (cmdline.Find("optimized-model-cache-dir", &value)) {
+      RETURN_IF_ERROR(value.AsString(&lconfig->optimized_model_cache_dir_));
+    }
+    if (cmdline.Find("run-admission-capacity", &value)) {
+      RETURN_IF_ERROR(value.AsString(&value_str));
+      int capacity = 0;
+      if (value_str == "auto") {
+        capacity = std::thread::hardware_concurrency();
+      } else {
+        RETURN_IF_ERROR(ParseIntValue(value_str, &capacity));
+      }
+      if (capacity < 0) {
+        return TRITONSERVER_ErrorNew(
+            TRITONSERVER_ERROR_INVALID_ARG,
+            (std::string("invalid run-admission-capacity value ") +
+             value_str + ", expected a non-negative integer or 'auto'")
+                .c_str());
+      }
+      if (capacity > 0) {
+        lconfig->run_admission_.reset(new RunAdmission(capacity));
+        LOG_MESSAGE(
+            TRITONSERVER_LOG_INFO,
+            (std::string("Limiting the intra-op threads of the runs in "
+                         "flight to ") +
+             std::to_string(capacity))
+                .c_str());
+      }
+    }
   }
   // Check if device memory tracker is explicitly enabled
   if (DeviceMemoryTracker::EnableFromBackendConfig(backend_config)) {
     lconfig->enable_memory_tracker_ = DeviceMemoryTracker::Init();
   }
+  // Metrics may be disabled in the server, in which case the load phase
+  // times are only logged.
+  err = TRITONSERVER_MetricFamilyNew(
+      &lconfig->load_duration_family_, TRITONSERVER_METRIC_KIND_COUNTER,
+      "nv_onnxruntime_load_duration_us",
+      "Cumulative time spent in each phase of loading models and "
+      "instances, in microseconds");
+  if (err != nullptr) {
+    LOG_MESSAGE(
+        TRITONSERVER_LOG_VERBOSE,
+        (std::string("Load duration metrics are not available: ") +
+         TRITONSERVER_ErrorMessage(err))
+            .c_str());
+    TRITONSERVER_ErrorDelete(err);
+    lconfig->load_duration_family_ = nullptr;
+  }
+  err = TRITONSERVER_MetricFamilyNew(
+      &lconfig->terminated_run_family_, TRITONSERVER_METRIC_KIND_COUNTER,
+      "nv_onnxruntime_terminated_runs",
+      "Number of runs terminated because all their requests were cancelled");
+  if (err != nullptr) {
+    LOG_MESSAGE(
+        TRITONSERVER_LOG_VERBOSE,
+        (std::string("Terminated run metrics are not available: ") +
+         TRITONSERVER_ErrorMessage(err))
+            .c_str());
+    TRITONSERVER_ErrorDelete(err);
+    lconfig->terminated_run_family_ = nullptr;
+  }
+  err = TRITONSERVER_MetricFamilyNew(
+      &lconfig->run_allocation_family_, TRITONSERVER_METRIC_KIND_COUNTER,
+      "nv_onnxruntime_run_allocations",
+      "Number of tensors and buffers created by the backend for the "
+      "executions of the model");
+  if (err != nullptr) {
+    LOG_MESSAGE(
+        TRITONSERVER_LOG_VERBOSE,
+        (std::string("Run allocation metrics are not available: ") +
+         TRITONSERVER_ErrorMessage(err))
+            .c_str());
+    TRITONSERVER_ErrorDelete(err);
+    lconfig->run_allocation_family_ = nullptr;
+  }
+  err = TRITONSERVER_MetricFamilyNew(
+      &lconfig->thread_cpu_time_family_, TRITONSERVER_METRIC_KIND_COUNTER,
+      "nv_onnxruntime_thread_cpu_time_us",
+      "Cumulative CPU time used by the ONNX Runtime threads of the model, "
+      "in microseconds");
+  if (err != nullptr) {
+    LOG_MESSAGE(
+        TRITONSERVER_LOG_VERBOSE,
+        (std::string("Thread CPU time metrics are not available: ") +
+         TRITONSERVER_ErrorMessage(err))
+            .c_str());
+    TRITONSERVER_ErrorDelete(err);
+    lconfig->thread_cpu_time_family_ = nullptr;
+  }
+  err = TRITONSERVER_MetricFamilyNew(
+      &lconfig->run_admission_wait_family_, TRITONSERVER_METRIC_KIND_COUNTER,
+      "nv_onnxruntime_run_admission_wait_us",
+      "Cumulative time the runs of the model waited to be admitted by the "
+      "run-admission-capacity limit, in microseconds");
+  if (err != nullptr) {
+    LOG_MESSAGE(
+        TRITONSERVER_LOG_VERBOSE,
+        (std::string("Run admission wait metrics are not available: ") +
+         TRITONSERVER_ErrorMessage(err))
+            .c_str());
+    TRITONSERVER_ErrorDelete(err);
+    lconfig->run_admission_wait_family_ = nullptr;
+  }
   RETURN_IF_ERROR(TRITONBACKEND_BackendSetState(
       backend, reinterpret_cast<void*>(lconfig.get())));
 
@@ -3128,9 +7021,11 @@ TRITONBACKEND_ModelInstanceExecute(
 
   // This backend specifies BLOCKING execution policy. That means that
   // we should not return from this function until execution is
-  // complete. Triton will automatically release 'instance' on return
-  // from this function so that it is again available to be used for
-  // another call to TRITONBACKEND_ModelInstanceExecute.
+  // complete, unless the model is run asynchronously in which case the
+  // execution completes from the ORT callback. Triton will automatically
+  // release 'instance' on return from this function so that it is again
+  // available to be used for another call to
+  // TRITONBACKEND_ModelInstanceExecute.
 
   LOG_MESSAGE(
       TRITONSERVER_LOG_VERBOSE,
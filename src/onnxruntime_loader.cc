@@ -32,10 +32,70 @@
 #include <string>
 #include <thread>
 
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif  // __linux__
+
 #include "onnxruntime_utils.h"
 
 namespace triton { namespace backend { namespace onnxruntime {
 
+namespace {
+
+// Make the memory allocated by the calling thread, and by the threads it
+// creates meanwhile, preferably come from a NUMA node, restoring the
+// previous memory policy of the thread when destroyed. Uses the
+// set_mempolicy syscall directly so that libnuma is not required.
+class NumaMemoryPreference {
+ public:
+  explicit NumaMemoryPreference(const int numa_node) : applied_(false)
+  {
+#ifdef __linux__
+    static constexpr int kMpolPreferred = 1;
+    if ((numa_node < 0) || (numa_node >= kMaxNodeCnt)) {
+      return;
+    }
+    if (syscall(
+            SYS_get_mempolicy, &prev_mode_, prev_mask_, kMaxNodeCnt, nullptr,
+            0) != 0) {
+      return;
+    }
+    unsigned long mask[kMaskWordCnt] = {};
+    mask[numa_node / kWordBits] = 1UL << (numa_node % kWordBits);
+    applied_ =
+        (syscall(SYS_set_mempolicy, kMpolPreferred, mask, kMaxNodeCnt) == 0);
+    if (!applied_) {
+      LOG_MESSAGE(
+          TRITONSERVER_LOG_WARN,
+          (std::string("unable to prefer memory of NUMA node ") +
+           std::to_string(numa_node))
+              .c_str());
+    }
+#endif  // __linux__
+  }
+
+  ~NumaMemoryPreference()
+  {
+#ifdef __linux__
+    if (applied_) {
+      syscall(SYS_set_mempolicy, prev_mode_, prev_mask_, kMaxNodeCnt);
+    }
+#endif  // __linux__
+  }
+
+ private:
+  static constexpr int kMaxNodeCnt = 1024;
+  static constexpr int kWordBits = 8 * sizeof(unsigned long);
+  static constexpr int kMaskWordCnt = kMaxNodeCnt / kWordBits;
+
+  bool applied_;
+  int prev_mode_{0};
+  unsigned long prev_mask_[kMaskWordCnt] = {};
+};
+
+}  // namespace
+
 std::unique_ptr<OnnxLoader> OnnxLoader::loader = nullptr;
 
 OnnxLoader::~OnnxLoader()
@@ -64,7 +124,21 @@ OnnxLoader::Init(common::TritonJson::Value& backend_config)
     // sessions. Use this in conjunction with DisablePerSessionThreads API or
     // else the session will use it's own thread pool.
     bool global_threadpool_enabled = false;
+    int global_intra_op_thread_count = 0;
     OrtThreadingOptions* threading_options = nullptr;
+    std::unique_ptr<OrtThreadHooks> global_thread_hooks;
+
+    // Number of sessions that can be created concurrently. By default as
+    // many sessions as there are hardware threads are created in parallel,
+    // a value of 1 serializes session creation.
+    int session_creation_concurrency = 0;
+
+    // Whether to register a CPU arena allocator on the environment that
+    // is shared by all sessions instead of each session having its own
+    // arena. 'shared_cpu_arena_cfg' holds the arena settings given on the
+    // command line, keyed by their ORT arena config name.
+    bool shared_cpu_arena_enabled = false;
+    std::vector<std::pair<const char*, size_t>> shared_cpu_arena_cfg;
 
     // Read backend config
     triton::common::TritonJson::Value cmdline;
@@ -88,6 +162,7 @@ OnnxLoader::Init(common::TritonJson::Value& backend_config)
             if (intra_op_num_threads > 0) {
               RETURN_IF_ORT_ERROR(ort_api->SetGlobalIntraOpNumThreads(
                   threading_options, intra_op_num_threads));
+              global_intra_op_thread_count = intra_op_num_threads;
             }
           }
           if (cmdline.Find("inter_op_thread_count", &value)) {
@@ -99,8 +174,68 @@ OnnxLoader::Init(common::TritonJson::Value& backend_config)
                   threading_options, inter_op_num_threads));
             }
           }
+          // If requested, the global threads are created by the backend
+          // so that they are named and optionally reniced.
+          bool thread_hooks_enabled = false;
+          int thread_nice = 0;
+          if (cmdline.Find("enable-ort-thread-hooks", &value)) {
+            RETURN_IF_ERROR(value.AsString(&value_str));
+            RETURN_IF_ERROR(ParseBoolValue(value_str, &thread_hooks_enabled));
+          }
+          if (cmdline.Find("ort-thread-nice", &value)) {
+            RETURN_IF_ERROR(value.AsString(&value_str));
+            RETURN_IF_ERROR(ParseIntValue(value_str, &thread_nice));
+            if ((thread_nice < -20) || (thread_nice > 19)) {
+              return TRITONSERVER_ErrorNew(
+                  TRITONSERVER_ERROR_INVALID_ARG,
+                  (std::string("invalid ort-thread-nice value ") + value_str +
+                   ", expected a value between -20 and 19")
+                      .c_str());
+            }
+          }
+          if (thread_hooks_enabled || (thread_nice != 0)) {
+            global_thread_hooks.reset(
+                new OrtThreadHooks("ort_global", thread_nice));
+            RETURN_IF_ORT_ERROR(
+                global_thread_hooks->Install(threading_options));
+          }
+        }
+      }
+      if (cmdline.Find("session-creation-concurrency", &value)) {
+        RETURN_IF_ERROR(value.AsString(&value_str));
+        RETURN_IF_ERROR(
+            ParseIntValue(value_str, &session_creation_concurrency));
+        if (session_creation_concurrency < 0) {
+          return TRITONSERVER_ErrorNew(
+              TRITONSERVER_ERROR_INVALID_ARG,
+              (std::string("invalid session-creation-concurrency value ") +
+               value_str + ", expected a non-negative integer")
+                  .c_str());
         }
       }
+      if (cmdline.Find("enable-shared-cpu-arena", &value)) {
+        RETURN_IF_ERROR(value.AsString(&value_str));
+        RETURN_IF_ERROR(ParseBoolValue(value_str, &shared_cpu_arena_enabled));
+      }
+      // Command line options for the shared CPU arena and the ORT arena
+      // config key each one sets.
+      static const std::pair<const char*, const char*> arena_options[] = {
+          {"shared-cpu-arena-max-memory", "max_mem"},
+          {"shared-cpu-arena-extend-strategy", "arena_extend_strategy"},
+          {"shared-cpu-arena-initial-chunk-size", "initial_chunk_size_bytes"},
+          {"shared-cpu-arena-max-dead-bytes-per-chunk",
+           "max_dead_bytes_per_chunk"}};
+      for (const auto& arena_option : arena_options) {
+        if (cmdline.Find(arena_option.first, &value)) {
+          RETURN_IF_ERROR(value.AsString(&value_str));
+          uint64_t arena_value;
+          RETURN_IF_ERROR(ParseUnsignedLongLongValue(value_str, &arena_value));
+          shared_cpu_arena_cfg.emplace_back(arena_option.second, arena_value);
+        }
+      }
+    }
+    if (session_creation_concurrency == 0) {
+      session_creation_concurrency = std::thread::hardware_concurrency();
     }
 
     if (global_threadpool_enabled && threading_options != nullptr) {
@@ -111,8 +246,16 @@ OnnxLoader::Init(common::TritonJson::Value& backend_config)
       status = ort_api->CreateEnv(logging_level, "log", &env);
     }
 
-    loader.reset(new OnnxLoader(env, global_threadpool_enabled));
+    loader.reset(new OnnxLoader(
+        env, global_threadpool_enabled, session_creation_concurrency,
+        shared_cpu_arena_enabled));
+    loader->global_thread_hooks_ = std::move(global_thread_hooks);
+    loader->global_intra_op_thread_count_ = global_intra_op_thread_count;
     RETURN_IF_ORT_ERROR(status);
+
+    if (shared_cpu_arena_enabled) {
+      RETURN_IF_ERROR(RegisterSharedCpuArena(env, shared_cpu_arena_cfg));
+    }
   } else {
     return TRITONSERVER_ErrorNew(
         TRITONSERVER_ERROR_ALREADY_EXISTS,
@@ -122,6 +265,49 @@ OnnxLoader::Init(common::TritonJson::Value& backend_config)
   return nullptr;  // success
 }
 
+TRITONSERVER_Error*
+OnnxLoader::RegisterSharedCpuArena(
+    OrtEnv* env, const std::vector<std::pair<const char*, size_t>>& cfg)
+{
+  std::vector<const char*> keys;
+  std::vector<size_t> values;
+  for (const auto& entry : cfg) {
+    keys.push_back(entry.first);
+    values.push_back(entry.second);
+  }
+
+  OrtArenaCfg* arena_cfg;
+  RETURN_IF_ORT_ERROR(ort_api->CreateArenaCfgV2(
+      keys.data(), values.data(), keys.size(), &arena_cfg));
+  std::unique_ptr<OrtArenaCfg, decltype(ort_api->ReleaseArenaCfg)>
+      arena_cfg_wrapper(arena_cfg, ort_api->ReleaseArenaCfg);
+
+  OrtMemoryInfo* memory_info;
+  RETURN_IF_ORT_ERROR(ort_api->CreateCpuMemoryInfo(
+      OrtArenaAllocator, OrtMemTypeDefault, &memory_info));
+  std::unique_ptr<OrtMemoryInfo, decltype(ort_api->ReleaseMemoryInfo)>
+      memory_info_wrapper(memory_info, ort_api->ReleaseMemoryInfo);
+
+  RETURN_IF_ORT_ERROR(
+      ort_api->CreateAndRegisterAllocator(env, memory_info, arena_cfg));
+
+  LOG_MESSAGE(
+      TRITONSERVER_LOG_INFO,
+      "Registered CPU arena allocator shared by all sessions");
+
+  return nullptr;  // success
+}
+
+bool
+OnnxLoader::IsSharedCpuArenaEnabled()
+{
+  if (loader != nullptr) {
+    return loader->shared_cpu_arena_enabled_;
+  }
+
+  return false;
+}
+
 void
 OnnxLoader::TryRelease(bool decrement_session_cnt)
 {
@@ -163,17 +349,73 @@ OnnxLoader::IsGlobalThreadPoolEnabled()
   return false;
 }
 
+int
+OnnxLoader::GlobalIntraOpThreadCount()
+{
+  if (loader != nullptr) {
+    return loader->global_intra_op_thread_count_;
+  }
+
+  return 0;
+}
+
 TRITONSERVER_Error*
 OnnxLoader::LoadSession(
     const bool is_path, const std::string& model,
-    const OrtSessionOptions* session_options, OrtSession** session)
+    const OrtSessionOptions* session_options, OrtSession** session,
+    OrtPrepackedWeightsContainer* prepacked_weights_container,
+    LoadPhaseTimes* times, const int numa_node)
 {
+  if (!is_path) {
+    return LoadSession(
+        model.data(), model.size(), session_options, session,
+        prepacked_weights_container, times, numa_node);
+  }
+
 #ifdef _WIN32
   std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>> converter;
   std::wstring ort_style_model_str = converter.from_bytes(model);
 #else
   const auto& ort_style_model_str = model;
 #endif
+  return CreateSession(
+      [&](OrtEnv* env) {
+        if (prepacked_weights_container != nullptr) {
+          return ort_api->CreateSessionWithPrepackedWeightsContainer(
+              env, ort_style_model_str.c_str(), session_options,
+              prepacked_weights_container, session);
+        }
+        return ort_api->CreateSession(
+            env, ort_style_model_str.c_str(), session_options, session);
+      },
+      times, numa_node);
+}
+
+TRITONSERVER_Error*
+OnnxLoader::LoadSession(
+    const void* model_data, const size_t model_data_length,
+    const OrtSessionOptions* session_options, OrtSession** session,
+    OrtPrepackedWeightsContainer* prepacked_weights_container,
+    LoadPhaseTimes* times, const int numa_node)
+{
+  return CreateSession(
+      [&](OrtEnv* env) {
+        if (prepacked_weights_container != nullptr) {
+          return ort_api->CreateSessionFromArrayWithPrepackedWeightsContainer(
+              env, model_data, model_data_length, session_options,
+              prepacked_weights_container, session);
+        }
+        return ort_api->CreateSessionFromArray(
+            env, model_data, model_data_length, session_options, session);
+      },
+      times, numa_node);
+}
+
+TRITONSERVER_Error*
+OnnxLoader::CreateSession(
+    const std::function<OrtStatus*(OrtEnv*)>& create_fn, LoadPhaseTimes* times,
+    const int numa_node)
+{
   if (loader != nullptr) {
     {
       std::lock_guard<std::mutex> lk(loader->mu_);
@@ -185,22 +427,39 @@ OnnxLoader::LoadSession(
       }
     }
 
+    // Sessions are created concurrently, up to the configured limit.
+    // Execution providers whose session creation is not thread-safe must
+    // be serialized by the caller.
+    uint64_t phase_start_ns = LoadPhaseTimes::Now();
+    {
+      std::unique_lock<std::mutex> lk(loader->session_creation_mu_);
+      loader->session_creation_cv_.wait(lk, [] {
+        return (loader->session_creation_concurrency_ == 0) ||
+               (loader->active_session_creation_cnt_ <
+                loader->session_creation_concurrency_);
+      });
+      loader->active_session_creation_cnt_++;
+    }
+    if (times != nullptr) {
+      phase_start_ns = times->Record("session_creation_wait", phase_start_ns);
+    }
+
+    // The initializers and the prepacked weights are allocated, and the
+    // session threads created, while the session is created.
     OrtStatus* status = nullptr;
     {
-      // [FIXME] Remove lock when ORT create session is thread safe [DLIS-4663]
-      static std::mutex ort_create_session_mu;
-      std::lock_guard<std::mutex> ort_lk(ort_create_session_mu);
-
-      if (!is_path) {
-        status = ort_api->CreateSessionFromArray(
-            loader->env_, ort_style_model_str.c_str(), model.size(),
-            session_options, session);
-      } else {
-        status = ort_api->CreateSession(
-            loader->env_, ort_style_model_str.c_str(), session_options,
-            session);
-      }
+      NumaMemoryPreference numa_preference(numa_node);
+      status = create_fn(loader->env_);
+    }
+    if (times != nullptr) {
+      times->Record("session_create", phase_start_ns);
+    }
+
+    {
+      std::lock_guard<std::mutex> lk(loader->session_creation_mu_);
+      loader->active_session_creation_cnt_--;
     }
+    loader->session_creation_cv_.notify_one();
 
     if (status != nullptr) {
       TryRelease(true);
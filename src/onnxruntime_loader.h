@@ -27,14 +27,21 @@
 
 #include <onnxruntime_c_api.h>
 
+#include <condition_variable>
+#include <functional>
 #include <memory>
 #include <mutex>
+#include <utility>
+#include <vector>
 
+#include "onnxruntime_threads.h"
 #include "triton/backend/backend_common.h"
 #include "triton/core/tritonbackend.h"
 
 namespace triton { namespace backend { namespace onnxruntime {
 
+class LoadPhaseTimes;
+
 /// A singleton to load Onnx model because loading models requires
 /// Onnx Runtime environment which is unique per process
 class OnnxLoader {
@@ -56,10 +63,38 @@ class OnnxLoader {
   /// \param model The Onnx model or path to the model.
   /// \param session_options The options to use when creating the session
   /// \param session Returns the Onnx model session
+  /// \param prepacked_weights_container If not nullptr, the container
+  /// that holds the prepacked weights shared between sessions.
+  /// \param times If not nullptr, records the time spent waiting to
+  /// create the session and creating it.
+  /// \param numa_node If not -1, the NUMA node the memory of the session,
+  /// such as its initializers, is allocated on.
   /// \return Error status.
   static TRITONSERVER_Error* LoadSession(
       const bool is_path, const std::string& model,
-      const OrtSessionOptions* session_options, OrtSession** session);
+      const OrtSessionOptions* session_options, OrtSession** session,
+      OrtPrepackedWeightsContainer* prepacked_weights_container = nullptr,
+      LoadPhaseTimes* times = nullptr, const int numa_node = -1);
+
+  /// Load a Onnx model from memory and return the corresponding
+  /// OrtSession.
+  ///
+  /// \param model_data The serialized model.
+  /// \param model_data_length The size of 'model_data', in bytes.
+  /// \param session_options The options to use when creating the session
+  /// \param session Returns the Onnx model session
+  /// \param prepacked_weights_container If not nullptr, the container
+  /// that holds the prepacked weights shared between sessions.
+  /// \param times If not nullptr, records the time spent waiting to
+  /// create the session and creating it.
+  /// \param numa_node If not -1, the NUMA node the memory of the session,
+  /// such as its initializers, is allocated on.
+  /// \return Error status.
+  static TRITONSERVER_Error* LoadSession(
+      const void* model_data, const size_t model_data_length,
+      const OrtSessionOptions* session_options, OrtSession** session,
+      OrtPrepackedWeightsContainer* prepacked_weights_container = nullptr,
+      LoadPhaseTimes* times = nullptr, const int numa_node = -1);
 
   /// Unload a Onnx model session
   ///
@@ -70,26 +105,77 @@ class OnnxLoader {
   /// If the loader is not initialized it returns false.
   static bool IsGlobalThreadPoolEnabled();
 
+  /// Returns the number of threads of the global intra-op thread pool
+  /// given in the backend config, 0 if ORT picks it or if the loader is
+  /// not initialized.
+  static int GlobalIntraOpThreadCount();
+
+  /// Returns whether the CPU arena allocator registered on the
+  /// environment should be used by the sessions instead of a per-session
+  /// arena. If the loader is not initialized it returns false.
+  static bool IsSharedCpuArenaEnabled();
+
  private:
-  OnnxLoader(OrtEnv* env, bool enable_global_threadpool = false)
+  OnnxLoader(
+      OrtEnv* env, bool enable_global_threadpool = false,
+      size_t session_creation_concurrency = 0,
+      bool enable_shared_cpu_arena = false)
       : env_(env), global_threadpool_enabled_(enable_global_threadpool),
-        live_session_cnt_(0), closing_(false)
+        shared_cpu_arena_enabled_(enable_shared_cpu_arena),
+        live_session_cnt_(0), closing_(false),
+        session_creation_concurrency_(session_creation_concurrency),
+        active_session_creation_cnt_(0)
   {
   }
 
+  /// Register a CPU arena allocator on 'env' to be shared by the sessions.
+  ///
+  /// \param env The environment to register the allocator on
+  /// \param cfg The arena config, as pairs of ORT arena config key and
+  /// value
+  static TRITONSERVER_Error* RegisterSharedCpuArena(
+      OrtEnv* env, const std::vector<std::pair<const char*, size_t>>& cfg);
+
   /// Decrease 'live_session_cnt_' if 'decrement_session_cnt' is true, and then
   /// release Onnx Runtime environment if it is closing and no live sessions
   ///
   /// \param decrement_session_cnt Whether to decrease the 'live_session_cnt_'
   static void TryRelease(bool decrement_session_cnt);
 
+  /// Create a session with 'create_fn' once the number of sessions being
+  /// created is below 'session_creation_concurrency_'.
+  ///
+  /// \param create_fn Creates the session using the given environment
+  /// \param times If not nullptr, records the time spent waiting for
+  /// the limit and in 'create_fn'.
+  /// \param numa_node If not -1, 'create_fn' is called with the memory
+  /// of the calling thread, and of the threads it creates, preferably
+  /// allocated on this NUMA node.
+  static TRITONSERVER_Error* CreateSession(
+      const std::function<OrtStatus*(OrtEnv*)>& create_fn,
+      LoadPhaseTimes* times, const int numa_node);
+
   static std::unique_ptr<OnnxLoader> loader;
 
   OrtEnv* env_;
   bool global_threadpool_enabled_;
+  int global_intra_op_thread_count_{0};
+  // Hooks creating the threads of the global thread pools, nullptr if ORT
+  // creates them. Destroyed after 'env_' is released.
+  std::unique_ptr<OrtThreadHooks> global_thread_hooks_;
+  bool shared_cpu_arena_enabled_;
   std::mutex mu_;
   size_t live_session_cnt_;
   bool closing_;
+
+  // Maximum number of sessions that can be created at the same time, 0
+  // means no limit. 'active_session_creation_cnt_' is the number of
+  // sessions currently being created and is protected by
+  // 'session_creation_mu_'.
+  size_t session_creation_concurrency_;
+  std::mutex session_creation_mu_;
+  std::condition_variable session_creation_cv_;
+  size_t active_session_creation_cnt_;
 };
 
 }}}  // namespace triton::backend::onnxruntime
@@ -0,0 +1,215 @@
+// Copyright (c) 2026, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "onnxruntime_threads.h"
+
+#include <system_error>
+#include <thread>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#endif  // __linux__
+
+#include "onnxruntime_utils.h"
+
+namespace triton { namespace backend { namespace onnxruntime {
+
+namespace {
+
+#ifdef __linux__
+uint64_t
+ClockNs(const clockid_t clock)
+{
+  struct timespec ts;
+  if (clock_gettime(clock, &ts) != 0) {
+    return 0;
+  }
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+#endif  // __linux__
+
+}  // namespace
+
+struct OrtThreadHooks::Thread {
+  OrtThreadHooks* hooks;
+  std::thread thread;
+  // Core the thread is pinned to, -1 if not pinned.
+  int core;
+};
+
+OrtThreadHooks::OrtThreadHooks(
+    const std::string& name, const int nice, const std::vector<int>& cores)
+    : name_(name), nice_(nice), cores_(cores), exited_cpu_time_ns_(0),
+      next_core_idx_(1)
+{
+}
+
+OrtStatus*
+OrtThreadHooks::Install(OrtSessionOptions* session_options)
+{
+  OrtStatus* status = ort_api->SessionOptionsSetCustomCreateThreadFn(
+      session_options, CreateThread);
+  if (status == nullptr) {
+    status = ort_api->SessionOptionsSetCustomThreadCreationOptions(
+        session_options, this);
+  }
+  if (status == nullptr) {
+    status = ort_api->SessionOptionsSetCustomJoinThreadFn(
+        session_options, JoinThread);
+  }
+  return status;
+}
+
+OrtStatus*
+OrtThreadHooks::Install(OrtThreadingOptions* threading_options)
+{
+  OrtStatus* status =
+      ort_api->SetGlobalCustomCreateThreadFn(threading_options, CreateThread);
+  if (status == nullptr) {
+    status =
+        ort_api->SetGlobalCustomThreadCreationOptions(threading_options, this);
+  }
+  if (status == nullptr) {
+    status =
+        ort_api->SetGlobalCustomJoinThreadFn(threading_options, JoinThread);
+  }
+  return status;
+}
+
+void
+OrtThreadHooks::ResetCores()
+{
+  std::lock_guard<std::mutex> lk(mu_);
+  next_core_idx_ = 1;
+}
+
+uint64_t
+OrtThreadHooks::CpuTimeNs()
+{
+  std::lock_guard<std::mutex> lk(mu_);
+  uint64_t cpu_time_ns = exited_cpu_time_ns_;
+#ifdef __linux__
+  for (Thread* thread : running_threads_) {
+    clockid_t clock;
+    if (pthread_getcpuclockid(thread->thread.native_handle(), &clock) == 0) {
+      cpu_time_ns += ClockNs(clock);
+    }
+  }
+#endif  // __linux__
+  return cpu_time_ns;
+}
+
+OrtCustomThreadHandle
+OrtThreadHooks::CreateThread(
+    void* hooks, OrtThreadWorkerFn worker_fn, void* worker_param)
+{
+  OrtThreadHooks* lhooks = reinterpret_cast<OrtThreadHooks*>(hooks);
+  Thread* thread = new Thread{lhooks, std::thread(), -1};
+  // Register the thread before it runs so that it exits after.
+  std::lock_guard<std::mutex> lk(lhooks->mu_);
+  if (!lhooks->cores_.empty()) {
+    thread->core =
+        lhooks->cores_[lhooks->next_core_idx_++ % lhooks->cores_.size()];
+  }
+  try {
+    thread->thread = std::thread(
+        &OrtThreadHooks::Run, lhooks, thread, worker_fn, worker_param);
+  }
+  catch (const std::system_error& ex) {
+    LOG_MESSAGE(
+        TRITONSERVER_LOG_ERROR,
+        (std::string("unable to create ONNX Runtime thread '") +
+         lhooks->name_ + "': " + ex.what())
+            .c_str());
+    if (!lhooks->cores_.empty()) {
+      lhooks->next_core_idx_--;
+    }
+    delete thread;
+    return nullptr;
+  }
+  lhooks->running_threads_.insert(thread);
+  return reinterpret_cast<OrtCustomThreadHandle>(thread);
+}
+
+void
+OrtThreadHooks::JoinThread(OrtCustomThreadHandle handle)
+{
+  Thread* thread =
+      const_cast<Thread*>(reinterpret_cast<const Thread*>(handle));
+  thread->thread.join();
+  delete thread;
+}
+
+void
+OrtThreadHooks::Run(
+    Thread* thread, OrtThreadWorkerFn worker_fn, void* worker_param)
+{
+#ifdef __linux__
+  // Thread names are limited to 15 characters, the end of the name is
+  // kept as it tells the instances of a model apart.
+  static constexpr size_t kMaxNameLength = 15;
+  const std::string name =
+      (name_.size() > kMaxNameLength)
+          ? name_.substr(name_.size() - kMaxNameLength)
+          : name_;
+  pthread_setname_np(pthread_self(), name.c_str());
+  if ((nice_ != 0) &&
+      (setpriority(PRIO_PROCESS, syscall(SYS_gettid), nice_) != 0)) {
+    LOG_MESSAGE(
+        TRITONSERVER_LOG_WARN,
+        (std::string("unable to set the nice value of ONNX Runtime thread '") +
+         name_ + "' to " + std::to_string(nice_))
+            .c_str());
+  }
+  if (thread->core >= 0) {
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(thread->core, &cpu_set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) !=
+        0) {
+      LOG_MESSAGE(
+          TRITONSERVER_LOG_WARN,
+          (std::string("unable to pin ONNX Runtime thread '") + name_ +
+           "' to core " + std::to_string(thread->core))
+              .c_str());
+    }
+  }
+#endif  // __linux__
+
+  worker_fn(worker_param);
+
+  std::lock_guard<std::mutex> lk(mu_);
+#ifdef __linux__
+  exited_cpu_time_ns_ += ClockNs(CLOCK_THREAD_CPUTIME_ID);
+#endif  // __linux__
+  running_threads_.erase(thread);
+}
+
+}}}  // namespace triton::backend::onnxruntime
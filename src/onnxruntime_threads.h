@@ -0,0 +1,97 @@
+// Copyright (c) 2026, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+
+#include <onnxruntime_c_api.h>
+
+#include <cstdint>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace triton { namespace backend { namespace onnxruntime {
+
+/// Creates the threads of ORT thread pools in place of ORT, so that the
+/// threads are named after their owner, optionally reniced and pinned,
+/// and their CPU time is accounted to their owner. Must outlive the
+/// sessions or the environment it is installed on.
+class OrtThreadHooks {
+ public:
+  /// \param name The name of the threads, truncated to the length the
+  /// platform allows keeping the end of the name.
+  /// \param nice If not 0, the nice value of the threads.
+  /// \param cores If not empty, the cores the threads are pinned to, one
+  /// thread per core in turn starting with the second core, as ORT
+  /// doesn't apply the thread affinities of the session options to the
+  /// threads it doesn't create. The first core is left to the thread
+  /// calling the session.
+  OrtThreadHooks(
+      const std::string& name, const int nice,
+      const std::vector<int>& cores = {});
+
+  /// Have the thread pools of the sessions created with
+  /// 'session_options' use the hooks.
+  OrtStatus* Install(OrtSessionOptions* session_options);
+
+  /// Have the global thread pools created with 'threading_options' use
+  /// the hooks.
+  OrtStatus* Install(OrtThreadingOptions* threading_options);
+
+  /// Pin the threads of the session created next starting with the
+  /// second core again, as ORT pins the threads of each session. Must be
+  /// called before creating each session with the hooks, so the
+  /// sessions using them must be created one at a time.
+  void ResetCores();
+
+  /// Return the CPU time used so far by the threads created by the
+  /// hooks, including the threads that exited, in nanoseconds.
+  uint64_t CpuTimeNs();
+
+ private:
+  struct Thread;
+
+  static OrtCustomThreadHandle CreateThread(
+      void* hooks, OrtThreadWorkerFn worker_fn, void* worker_param);
+  static void JoinThread(OrtCustomThreadHandle handle);
+
+  // Body of the threads created by the hooks.
+  void Run(Thread* thread, OrtThreadWorkerFn worker_fn, void* worker_param);
+
+  const std::string name_;
+  const int nice_;
+  const std::vector<int> cores_;
+
+  // Threads that are running, CPU time of the threads that exited and
+  // index in 'cores_' of the core of the next thread, protected by
+  // 'mu_'. The index is reset by ResetCores() for each session.
+  std::mutex mu_;
+  std::set<Thread*> running_threads_;
+  uint64_t exited_cpu_time_ns_;
+  size_t next_core_idx_;
+};
+
+}}}  // namespace triton::backend::onnxruntime
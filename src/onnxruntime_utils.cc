@@ -26,12 +26,36 @@
 
 #include "onnxruntime_utils.h"
 
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif  // !_WIN32
+
 namespace triton { namespace backend { namespace onnxruntime {
 
 const OrtApi* ort_api = OrtGetApiBase()->GetApi(ORT_API_VERSION);
 
 namespace {
 
+#ifndef _WIN32
+std::string
+StatIdentity(const struct stat& st)
+{
+  return std::to_string(st.st_dev) + ":" + std::to_string(st.st_ino);
+}
+#endif  // !_WIN32
+
 std::string
 OnnxTypeName(ONNXType onnx_type)
 {
@@ -480,6 +504,462 @@ OverridableInitializerInfos(
       session, allocator, NameType::INITIALIZER, infos);
 }
 
+TRITONSERVER_Error*
+MappedFile::Create(const std::string& path, std::unique_ptr<MappedFile>* file)
+{
+#ifdef _WIN32
+  return TRITONSERVER_ErrorNew(
+      TRITONSERVER_ERROR_UNSUPPORTED,
+      "memory-mapped model loading is not supported on Windows");
+#else
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd == -1) {
+    return TRITONSERVER_ErrorNew(
+        TRITONSERVER_ERROR_INTERNAL,
+        (std::string("failed to open '") + path + "': " + strerror(errno))
+            .c_str());
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    const int err = errno;
+    close(fd);
+    return TRITONSERVER_ErrorNew(
+        TRITONSERVER_ERROR_INTERNAL,
+        (std::string("failed to stat '") + path + "': " + strerror(err))
+            .c_str());
+  }
+  if (st.st_size == 0) {
+    close(fd);
+    return TRITONSERVER_ErrorNew(
+        TRITONSERVER_ERROR_INVALID_ARG,
+        (std::string("unable to map empty file '") + path + "'").c_str());
+  }
+
+  // The mapping stays valid after the descriptor is closed.
+  void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  const int err = errno;
+  close(fd);
+  if (data == MAP_FAILED) {
+    return TRITONSERVER_ErrorNew(
+        TRITONSERVER_ERROR_INTERNAL,
+        (std::string("failed to map '") + path + "': " + strerror(err))
+            .c_str());
+  }
+
+  file->reset(new MappedFile(data, st.st_size, StatIdentity(st)));
+  return nullptr;  // success
+#endif  // _WIN32
+}
+
+TRITONSERVER_Error*
+MappedFile::Identity(const std::string& path, std::string* identity)
+{
+#ifdef _WIN32
+  return TRITONSERVER_ErrorNew(
+      TRITONSERVER_ERROR_UNSUPPORTED,
+      "memory-mapped model loading is not supported on Windows");
+#else
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0) {
+    return TRITONSERVER_ErrorNew(
+        TRITONSERVER_ERROR_INTERNAL,
+        (std::string("failed to stat '") + path + "': " + strerror(errno))
+            .c_str());
+  }
+  *identity = StatIdentity(st);
+  return nullptr;  // success
+#endif  // _WIN32
+}
+
+MappedFile::~MappedFile()
+{
+#ifndef _WIN32
+  munmap(data_, size_);
+#endif  // !_WIN32
+}
+
+uint64_t
+LoadPhaseTimes::Now()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+uint64_t
+LoadPhaseTimes::Record(const std::string& phase, const uint64_t start_ns)
+{
+  const uint64_t now_ns = Now();
+  Add(phase, now_ns - start_ns);
+  return now_ns;
+}
+
+void
+LoadPhaseTimes::Add(const std::string& phase, const uint64_t duration_ns)
+{
+  for (auto& entry : phases_) {
+    if (entry.first == phase) {
+      entry.second += duration_ns;
+      return;
+    }
+  }
+  phases_.emplace_back(phase, duration_ns);
+}
+
+std::string
+LoadPhaseTimes::ToString() const
+{
+  uint64_t total_ns = 0;
+  for (const auto& entry : phases_) {
+    total_ns += entry.second;
+  }
+
+  std::stringstream ss;
+  ss << std::fixed << std::setprecision(3) << "total=" << (total_ns / 1e6)
+     << "ms";
+  for (const auto& entry : phases_) {
+    ss << " " << entry.first << "=" << (entry.second / 1e6) << "ms";
+  }
+  return ss.str();
+}
+
+uint64_t
+RunAdmission::Acquire(const size_t weight, const int priority)
+{
+  const size_t lweight = std::min(weight, capacity_);
+  std::unique_lock<std::mutex> lk(mu_);
+  if (waiters_.empty() && (available_ >= lweight)) {
+    available_ -= lweight;
+    return 0;
+  }
+
+  const uint64_t start_ns = LoadPhaseTimes::Now();
+  const auto key = std::make_pair(-priority, next_seq_++);
+  waiters_.insert(key);
+  cv_.wait(lk, [this, &key, lweight] {
+    return (*waiters_.begin() == key) && (available_ >= lweight);
+  });
+  waiters_.erase(key);
+  available_ -= lweight;
+  lk.unlock();
+  // The next waiter may fit in what is left.
+  cv_.notify_all();
+
+  return LoadPhaseTimes::Now() - start_ns;
+}
+
+void
+RunAdmission::Release(const size_t weight)
+{
+  {
+    std::lock_guard<std::mutex> lk(mu_);
+    available_ += std::min(weight, capacity_);
+  }
+  cv_.notify_all();
+}
+
+uint64_t
+HashBytes(const void* data, const size_t byte_size, uint64_t hash)
+{
+  const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+  for (size_t i = 0; i < byte_size; ++i) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+TRITONSERVER_Error*
+HashFile(const std::string& path, uint64_t* hash)
+{
+  std::ifstream in(path, std::ios::in | std::ios::binary);
+  if (!in) {
+    return TRITONSERVER_ErrorNew(
+        TRITONSERVER_ERROR_INTERNAL,
+        (std::string("failed to open '") + path + "' for hashing").c_str());
+  }
+
+  std::vector<char> buffer(1 << 20);
+  while (in) {
+    in.read(buffer.data(), buffer.size());
+    *hash = HashBytes(buffer.data(), in.gcount(), *hash);
+  }
+  if (in.bad()) {
+    return TRITONSERVER_ErrorNew(
+        TRITONSERVER_ERROR_INTERNAL,
+        (std::string("failed to read '") + path + "' for hashing").c_str());
+  }
+
+  return nullptr;  // success
+}
+
+std::string
+CpuIsaSignature()
+{
+#if defined(__x86_64__) || defined(_M_X64)
+  std::string signature = "x86_64";
+#elif defined(__aarch64__) || defined(_M_ARM64)
+  std::string signature = "aarch64";
+#else
+  std::string signature = "unknown";
+#endif
+
+  // The first processor is representative of the host. x86 lists the
+  // extensions as "flags", ARM as "Features".
+  std::ifstream cpuinfo("/proc/cpuinfo");
+  std::string line;
+  while (std::getline(cpuinfo, line)) {
+    if ((line.rfind("flags", 0) == 0) || (line.rfind("Features", 0) == 0)) {
+      const size_t colon = line.find(':');
+      if (colon != std::string::npos) {
+        signature += ":" + line.substr(colon + 1);
+      }
+      break;
+    }
+  }
+
+  return signature;
+}
+
+size_t
+RemoveStaleCacheFiles(
+    const std::string& cache_path, const std::chrono::seconds max_age)
+{
+  namespace fs = std::filesystem;
+  const fs::path keep(cache_path);
+  const auto oldest = fs::file_time_type::clock::now() - max_age;
+  size_t removed = 0;
+  std::error_code ec;
+  for (fs::directory_iterator it(keep.parent_path(), ec), end;
+       !ec && (it != end); it.increment(ec)) {
+    const fs::path& path = it->path();
+    const std::string name = path.filename().string();
+    const bool entry = (path.extension() == ".ort");
+    const bool tmp = (name.find(".ort.tmp") != std::string::npos);
+    if ((!entry && !tmp) || (path.filename() == keep.filename())) {
+      continue;
+    }
+    std::error_code file_ec;
+    const auto mtime = fs::last_write_time(path, file_ec);
+    if (!file_ec && (mtime < oldest) && fs::remove(path, file_ec)) {
+      ++removed;
+    }
+  }
+  return removed;
+}
+
+TRITONSERVER_Error*
+ParseIntListValue(const std::string& value, std::vector<int64_t>* list)
+{
+  list->clear();
+  std::stringstream ss(value);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    int64_t parsed;
+    RETURN_IF_ERROR(ParseLongLongValue(item, &parsed));
+    list->push_back(parsed);
+  }
+
+  return nullptr;  // success
+}
+
+void
+ParseStringListValue(const std::string& value, std::vector<std::string>* list)
+{
+  list->clear();
+  std::stringstream ss(value);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    if (!item.empty()) {
+      list->push_back(item);
+    }
+  }
+}
+
+TRITONSERVER_Error*
+ParseCpuCoreList(const std::string& value, std::vector<int>* cores)
+{
+  cores->clear();
+  std::stringstream ss(value);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    const size_t dash = item.find('-');
+    int first, last;
+    if (dash == std::string::npos) {
+      RETURN_IF_ERROR(ParseIntValue(item, &first));
+      last = first;
+    } else {
+      RETURN_IF_ERROR(ParseIntValue(item.substr(0, dash), &first));
+      RETURN_IF_ERROR(ParseIntValue(item.substr(dash + 1), &last));
+    }
+    if ((first < 0) || (last < first)) {
+      return TRITONSERVER_ErrorNew(
+          TRITONSERVER_ERROR_INVALID_ARG,
+          (std::string("invalid CPU core range '") + item + "' in '" + value +
+           "'")
+              .c_str());
+    }
+    for (int core = first; core <= last; ++core) {
+      cores->push_back(core);
+    }
+  }
+  if (cores->empty()) {
+    return TRITONSERVER_ErrorNew(
+        TRITONSERVER_ERROR_INVALID_ARG,
+        (std::string("no CPU core in '") + value + "'").c_str());
+  }
+
+  return nullptr;  // success
+}
+
+TRITONSERVER_Error*
+NumaNodeCpuCores(const int numa_node, std::vector<int>* cores)
+{
+  const std::string path = "/sys/devices/system/node/node" +
+                           std::to_string(numa_node) + "/cpulist";
+  std::ifstream file(path);
+  std::string core_list;
+  if (!file || !std::getline(file, core_list)) {
+    return TRITONSERVER_ErrorNew(
+        TRITONSERVER_ERROR_UNAVAILABLE,
+        (std::string("unable to read the CPU cores of NUMA node ") +
+         std::to_string(numa_node) + " from '" + path + "'")
+            .c_str());
+  }
+
+  return ParseCpuCoreList(core_list, cores);
+}
+
+namespace {
+
+template <typename T>
+void
+FillTypedElements(const double value, const size_t element_cnt, char* buffer)
+{
+  const T typed_value = static_cast<T>(value);
+  for (size_t idx = 0; idx < element_cnt; ++idx) {
+    std::memcpy(buffer + idx * sizeof(T), &typed_value, sizeof(T));
+  }
+}
+
+}  // namespace
+
+TRITONSERVER_Error*
+FillElements(
+    const TRITONSERVER_DataType datatype, const double value,
+    const size_t element_cnt, char* buffer)
+{
+  switch (datatype) {
+    case TRITONSERVER_TYPE_BOOL:
+      FillTypedElements<bool>(value, element_cnt, buffer);
+      break;
+    case TRITONSERVER_TYPE_UINT8:
+      FillTypedElements<uint8_t>(value, element_cnt, buffer);
+      break;
+    case TRITONSERVER_TYPE_UINT16:
+      FillTypedElements<uint16_t>(value, element_cnt, buffer);
+      break;
+    case TRITONSERVER_TYPE_UINT32:
+      FillTypedElements<uint32_t>(value, element_cnt, buffer);
+      break;
+    case TRITONSERVER_TYPE_UINT64:
+      FillTypedElements<uint64_t>(value, element_cnt, buffer);
+      break;
+    case TRITONSERVER_TYPE_INT8:
+      FillTypedElements<int8_t>(value, element_cnt, buffer);
+      break;
+    case TRITONSERVER_TYPE_INT16:
+      FillTypedElements<int16_t>(value, element_cnt, buffer);
+      break;
+    case TRITONSERVER_TYPE_INT32:
+      FillTypedElements<int32_t>(value, element_cnt, buffer);
+      break;
+    case TRITONSERVER_TYPE_INT64:
+      FillTypedElements<int64_t>(value, element_cnt, buffer);
+      break;
+    case TRITONSERVER_TYPE_FP32:
+      FillTypedElements<float>(value, element_cnt, buffer);
+      break;
+    case TRITONSERVER_TYPE_FP64:
+      FillTypedElements<double>(value, element_cnt, buffer);
+      break;
+    case TRITONSERVER_TYPE_FP16:
+    case TRITONSERVER_TYPE_BF16:
+      if (value != 0) {
+        return TRITONSERVER_ErrorNew(
+            TRITONSERVER_ERROR_INVALID_ARG,
+            (std::string("only 0 can be used to fill ") +
+             TRITONSERVER_DataTypeString(datatype) + " elements")
+                .c_str());
+      }
+      std::memset(buffer, 0, element_cnt * 2);
+      break;
+    default:
+      return TRITONSERVER_ErrorNew(
+          TRITONSERVER_ERROR_INVALID_ARG,
+          (std::string("unable to fill ") +
+           TRITONSERVER_DataTypeString(datatype) + " elements")
+              .c_str());
+  }
+
+  return nullptr;  // success
+}
+
+void
+PadDimension(
+    const char* src, const std::vector<int64_t>& shape, const size_t dim,
+    const int64_t padded_size, const size_t element_byte_size,
+    const char* pad_element, char* dst)
+{
+  // View the tensor as [outer, shape[dim], inner] and copy each of the
+  // 'outer' slices followed by its padding.
+  int64_t outer_cnt = 1;
+  for (size_t idx = 0; idx < dim; ++idx) {
+    outer_cnt *= shape[idx];
+  }
+  size_t inner_byte_size = element_byte_size;
+  for (size_t idx = dim + 1; idx < shape.size(); ++idx) {
+    inner_byte_size *= shape[idx];
+  }
+  const size_t src_slice_byte_size = shape[dim] * inner_byte_size;
+  const size_t pad_element_cnt =
+      (padded_size - shape[dim]) * (inner_byte_size / element_byte_size);
+  for (int64_t outer = 0; outer < outer_cnt; ++outer) {
+    std::memcpy(dst, src, src_slice_byte_size);
+    src += src_slice_byte_size;
+    dst += src_slice_byte_size;
+    for (size_t idx = 0; idx < pad_element_cnt; ++idx) {
+      std::memcpy(dst, pad_element, element_byte_size);
+      dst += element_byte_size;
+    }
+  }
+}
+
+void
+TrimDimension(
+    char* buffer, const std::vector<int64_t>& shape, const size_t dim,
+    const int64_t trimmed_size, const size_t element_byte_size)
+{
+  int64_t outer_cnt = 1;
+  for (size_t idx = 0; idx < dim; ++idx) {
+    outer_cnt *= shape[idx];
+  }
+  size_t inner_byte_size = element_byte_size;
+  for (size_t idx = dim + 1; idx < shape.size(); ++idx) {
+    inner_byte_size *= shape[idx];
+  }
+  // The trimmed slices are never after the slices they are moved from,
+  // so they can be compacted front to back.
+  const size_t src_slice_byte_size = shape[dim] * inner_byte_size;
+  const size_t dst_slice_byte_size = trimmed_size * inner_byte_size;
+  for (int64_t outer = 0; outer < outer_cnt; ++outer) {
+    std::memmove(
+        buffer + outer * dst_slice_byte_size,
+        buffer + outer * src_slice_byte_size, dst_slice_byte_size);
+  }
+}
+
 TRITONSERVER_Error*
 CompareDimsSupported(
     const std::string& model_name, const std::string& tensor_name,
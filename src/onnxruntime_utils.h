@@ -28,9 +28,14 @@
 
 #include <onnxruntime_c_api.h>
 
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
 #include <set>
 #include <string>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "triton/backend/backend_common.h"
@@ -71,6 +76,20 @@ extern const OrtApi* ort_api;
     }                                                                        \
   } while (false)
 
+#define LOG_IF_ORT_ERROR(S, MSG)                                             \
+  do {                                                                       \
+    OrtStatus* status__ = (S);                                               \
+    if (status__ != nullptr) {                                               \
+      LOG_MESSAGE(                                                           \
+          TRITONSERVER_LOG_ERROR,                                            \
+          (std::string(MSG) + ": onnx runtime error " +                      \
+           std::to_string(ort_api->GetErrorCode(status__)) + ": " +          \
+           ort_api->GetErrorMessage(status__))                               \
+              .c_str());                                                     \
+      ort_api->ReleaseStatus(status__);                                      \
+    }                                                                        \
+  } while (false)
+
 #define THROW_IF_BACKEND_MODEL_ORT_ERROR(S)                                  \
   do {                                                                       \
     OrtStatus* status__ = (S);                                               \
@@ -118,11 +137,24 @@ struct TypeInfoDeleter {
   void operator()(OrtTypeInfo* f) { ort_api->ReleaseTypeInfo(f); }
 };
 
+/// Deleter for OrtValue.
+struct ValueDeleter {
+  void operator()(OrtValue* f) { ort_api->ReleaseValue(f); }
+};
+
 /// Deleter for OrtSessionOptions.
 struct SessionOptionsDeleter {
   void operator()(OrtSessionOptions* f) { ort_api->ReleaseSessionOptions(f); }
 };
 
+/// Deleter for OrtPrepackedWeightsContainer.
+struct PrepackedWeightsContainerDeleter {
+  void operator()(OrtPrepackedWeightsContainer* f)
+  {
+    ort_api->ReleasePrepackedWeightsContainer(f);
+  }
+};
+
 std::string OnnxDataTypeName(ONNXTensorElementDataType onnx_type);
 
 TRITONSERVER_DataType ConvertFromOnnxDataType(
@@ -152,6 +184,162 @@ TRITONSERVER_Error* InputInfos(
 TRITONSERVER_Error* OutputInfos(
     OrtSession* session, OrtAllocator* allocator, OnnxTensorInfoMap& infos);
 
+/// A read-only memory mapping of a file. The mapped pages are backed by
+/// the page cache so mappings of the same file, in this or another
+/// process, share the same physical memory.
+class MappedFile {
+ public:
+  /// Map the file at 'path'. Returns UNSUPPORTED on platforms without
+  /// memory-mapped files.
+  static TRITONSERVER_Error* Create(
+      const std::string& path, std::unique_ptr<MappedFile>* file);
+  /// Return in 'identity' the device and inode of the file at 'path',
+  /// which change when the file is replaced. The inode of a mapped file
+  /// is not reused while the mapping exists.
+  static TRITONSERVER_Error* Identity(
+      const std::string& path, std::string* identity);
+  ~MappedFile();
+
+  const void* Data() const { return data_; }
+  size_t Size() const { return size_; }
+  /// The identity of the file that is mapped, see Identity().
+  const std::string& FileIdentity() const { return identity_; }
+
+ private:
+  MappedFile(void* data, size_t size, const std::string& identity)
+      : data_(data), size_(size), identity_(identity)
+  {
+  }
+
+  void* data_;
+  size_t size_;
+  std::string identity_;
+};
+
+/// Wall-clock time spent in the phases of loading a model or an
+/// instance, in the order the phases were first recorded.
+class LoadPhaseTimes {
+ public:
+  /// Return the current time in nanoseconds, to be used as the start of
+  /// a phase.
+  static uint64_t Now();
+
+  /// Add the time elapsed since 'start_ns' to 'phase' and return the
+  /// current time so that it can be used as the start of the next phase.
+  uint64_t Record(const std::string& phase, const uint64_t start_ns);
+
+  /// Add 'duration_ns' to 'phase'.
+  void Add(const std::string& phase, const uint64_t duration_ns);
+
+  /// Return the phases as space-separated 'phase=<ms>ms' pairs, preceded
+  /// by the total.
+  std::string ToString() const;
+
+  const std::vector<std::pair<std::string, uint64_t>>& Phases() const
+  {
+    return phases_;
+  }
+
+ private:
+  std::vector<std::pair<std::string, uint64_t>> phases_;
+};
+
+/// A weighted semaphore bounding the total intra-op parallelism of the
+/// runs in flight, shared by all the models. A run holds as many units
+/// as the threads it may use. Waiting runs are admitted by decreasing
+/// priority, then in arrival order, and a run is only admitted once the
+/// runs ahead of it are, so that large runs are not starved.
+class RunAdmission {
+ public:
+  explicit RunAdmission(const size_t capacity)
+      : capacity_(capacity), available_(capacity), next_seq_(0)
+  {
+  }
+
+  /// Wait until 'weight' units are available and take them. A weight
+  /// larger than the capacity takes the whole capacity. Return the time
+  /// spent waiting in nanoseconds.
+  uint64_t Acquire(const size_t weight, const int priority);
+
+  /// Give back the 'weight' units taken by Acquire().
+  void Release(const size_t weight);
+
+  size_t Capacity() const { return capacity_; }
+
+ private:
+  const size_t capacity_;
+  std::mutex mu_;
+  std::condition_variable cv_;
+  size_t available_;
+  // Waiting runs as (-priority, arrival sequence number) so that the
+  // first one is the next to be admitted.
+  uint64_t next_seq_;
+  std::set<std::pair<int, uint64_t>> waiters_;
+};
+
+/// Initial value for a hash computed with HashBytes() and HashFile().
+constexpr uint64_t kHashOffsetBasis = 14695981039346656037ULL;
+
+/// Fold 'byte_size' bytes starting at 'data' into 'hash' using 64-bit
+/// FNV-1a and return the result.
+uint64_t HashBytes(const void* data, const size_t byte_size, uint64_t hash);
+
+/// Fold the content of the file at 'path' into 'hash'.
+TRITONSERVER_Error* HashFile(const std::string& path, uint64_t* hash);
+
+/// Return a description of the CPU architecture and of the instruction
+/// set extensions of the host, such as the flags of /proc/cpuinfo on
+/// Linux, to tell apart hosts on which ORT may optimize a graph
+/// differently.
+std::string CpuIsaSignature();
+
+/// Remove the optimized models and the temporary files of interrupted
+/// saves that sit next to 'cache_path' and were not written within
+/// 'max_age', and return the number of files removed. 'cache_path'
+/// itself is kept. Files that can't be removed are skipped.
+size_t RemoveStaleCacheFiles(
+    const std::string& cache_path, const std::chrono::seconds max_age);
+
+/// Parse 'value', a comma-separated list of integers such as "1,8,32",
+/// into 'list'.
+TRITONSERVER_Error* ParseIntListValue(
+    const std::string& value, std::vector<int64_t>* list);
+
+/// Parse 'value', a comma-separated list of names such as "a,b", into
+/// 'list'.
+void ParseStringListValue(
+    const std::string& value, std::vector<std::string>* list);
+
+/// Parse 'value', a comma-separated list of CPU cores and ranges of
+/// cores such as "0-3,8", into 'cores'.
+TRITONSERVER_Error* ParseCpuCoreList(
+    const std::string& value, std::vector<int>* cores);
+
+/// Return in 'cores' the CPU cores of NUMA node 'numa_node', as listed
+/// by the kernel.
+TRITONSERVER_Error* NumaNodeCpuCores(
+    const int numa_node, std::vector<int>* cores);
+
+/// Set the 'element_cnt' elements of 'datatype' at 'buffer' to 'value'.
+/// Only 0 is supported for FP16 and BF16.
+TRITONSERVER_Error* FillElements(
+    const TRITONSERVER_DataType datatype, const double value,
+    const size_t element_cnt, char* buffer);
+
+/// Copy the tensor of 'shape' at 'src' to 'dst', growing dimension 'dim'
+/// to 'padded_size' and filling the added elements with 'pad_element',
+/// which is 'element_byte_size' bytes long.
+void PadDimension(
+    const char* src, const std::vector<int64_t>& shape, const size_t dim,
+    const int64_t padded_size, const size_t element_byte_size,
+    const char* pad_element, char* dst);
+
+/// Shrink dimension 'dim' of the tensor of 'shape' at 'buffer' to
+/// 'trimmed_size' in place, keeping the leading elements of 'dim'.
+void TrimDimension(
+    char* buffer, const std::vector<int64_t>& shape, const size_t dim,
+    const int64_t trimmed_size, const size_t element_byte_size);
+
 TRITONSERVER_Error* CompareDimsSupported(
     const std::string& model_name, const std::string& tensor_name,
     const std::vector<int64_t>& model_shape, const std::vector<int64_t>& dims,
@@ -0,0 +1,95 @@
+# Copyright 2023, NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+import os
+import sys
+
+import numpy as np
+import onnx
+
+
+def save_model(model_dir, name, nodes, inputs, outputs, initializers=[]):
+    graph_proto = onnx.helper.make_graph(
+        nodes, name, inputs, outputs, initializer=initializers
+    )
+    model_def = onnx.helper.make_model(graph_proto, producer_name="triton")
+    os.makedirs(os.path.join(model_dir, name, "1"), exist_ok=True)
+    onnx.save(model_def, os.path.join(model_dir, name, "1", "model.onnx"))
+
+
+# Create the models used in this test under the model repository given as
+# argument.
+if __name__ == "__main__":
+    model_dir = sys.argv[1]
+    fp32 = onnx.TensorProto.FLOAT
+
+    # OUTPUT = INPUT + 1
+    one = onnx.helper.make_tensor(
+        name="ONE", data_type=fp32, dims=(1,), vals=np.ones((1,)).astype(float)
+    )
+    save_model(
+        model_dir,
+        "add_one_batched",
+        [onnx.helper.make_node("Add", ["INPUT", "ONE"], ["OUTPUT"])],
+        [onnx.helper.make_tensor_value_info("INPUT", fp32, [-1, 4])],
+        [onnx.helper.make_tensor_value_info("OUTPUT", fp32, [-1, 4])],
+        [one],
+    )
+
+    # OUTPUT = shape of the string INPUT
+    save_model(
+        model_dir,
+        "string_shape",
+        [onnx.helper.make_node("Shape", ["INPUT"], ["OUTPUT"])],
+        [onnx.helper.make_tensor_value_info("INPUT", onnx.TensorProto.STRING, [2])],
+        [onnx.helper.make_tensor_value_info("OUTPUT", onnx.TensorProto.INT64, [1])],
+    )
+
+    # OUTPUT = INPUT * MASK, with INPUT padded and MASK generated by the
+    # backend
+    save_model(
+        model_dir,
+        "mask_bucketed",
+        [onnx.helper.make_node("Mul", ["INPUT", "MASK"], ["OUTPUT"])],
+        [
+            onnx.helper.make_tensor_value_info("INPUT", fp32, [-1, -1]),
+            onnx.helper.make_tensor_value_info("MASK", fp32, [-1, -1]),
+        ],
+        [onnx.helper.make_tensor_value_info("OUTPUT", fp32, [-1, -1])],
+    )
+
+    # OUTPUT = INPUT + COUNT, with COUNT the element count of INPUT given
+    # by a batch input
+    save_model(
+        model_dir,
+        "add_element_count",
+        [onnx.helper.make_node("Add", ["INPUT", "COUNT"], ["OUTPUT"])],
+        [
+            onnx.helper.make_tensor_value_info("INPUT", fp32, [-1, 4]),
+            onnx.helper.make_tensor_value_info("COUNT", fp32, [1]),
+        ],
+        [onnx.helper.make_tensor_value_info("OUTPUT", fp32, [-1, 4])],
+    )
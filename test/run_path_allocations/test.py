@@ -0,0 +1,129 @@
+#!/usr/bin/env python
+# Copyright 2023, NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+import re
+import unittest
+
+import numpy as np
+import requests
+import tritonclient.http as httpclient
+
+
+class RunPathAllocationTest(unittest.TestCase):
+    def setUp(self):
+        self.client_ = httpclient.InferenceServerClient("localhost:8000")
+
+    def _run_allocations(self, model_name):
+        metrics = requests.get("http://localhost:8002/metrics").text
+        pattern = (
+            r'^nv_onnxruntime_run_allocations\{model="'
+            + model_name
+            + r'",version="1"\} (\d+)$'
+        )
+        match = re.search(pattern, metrics, re.MULTILINE)
+        self.assertIsNotNone(match, "run allocation metric not found")
+        return int(match.group(1))
+
+    def _check_allocations(self, model_name, infers, per_run_allocations):
+        # The first executions of each batch shape create the buffers and
+        # the tensors kept for the next executions. Then each run only
+        # creates the tensors that can't be kept: the ones wrapping the
+        # inputs of a single request and the outputs allocated by ORT.
+        for _ in range(2):
+            for infer in infers:
+                infer()
+        warm_allocations = self._run_allocations(model_name)
+        self.assertGreater(warm_allocations, 0)
+
+        run_cnt = 5
+        for _ in range(run_cnt):
+            for infer in infers:
+                infer()
+        self.assertEqual(
+            self._run_allocations(model_name) - warm_allocations,
+            run_cnt * len(infers) * per_run_allocations,
+        )
+
+    def _infer_fp32(self, model_name, input_data, expected_output):
+        input = httpclient.InferInput("INPUT", input_data.shape, "FP32")
+        input.set_data_from_numpy(input_data)
+        results = self.client_.infer(model_name, [input])
+        np.testing.assert_allclose(results.as_numpy("OUTPUT"), expected_output)
+
+    def test_fp32_input(self):
+        # The input of the single request is wrapped in place.
+        def infer(batch_size):
+            input_data = np.arange(batch_size * 4, dtype=np.float32).reshape(
+                (batch_size, 4)
+            )
+            self._infer_fp32("add_one_batched", input_data, input_data + 1)
+
+        self._check_allocations(
+            "add_one_batched", [lambda: infer(1), lambda: infer(2)], 1
+        )
+
+    def test_string_input(self):
+        # The string tensor and the output are kept.
+        def infer():
+            input_data = np.array(["hello", "world"], dtype=np.object_)
+            input = httpclient.InferInput("INPUT", input_data.shape, "BYTES")
+            input.set_data_from_numpy(input_data)
+            results = self.client_.infer("string_shape", [input])
+            np.testing.assert_array_equal(
+                results.as_numpy("OUTPUT"), np.array([2], dtype=np.int64)
+            )
+
+        self._check_allocations("string_shape", [infer], 0)
+
+    def test_bucketed_input(self):
+        # The input is padded into a kept tensor and the mask is kept, but
+        # the trimmed output has a variable shape so ORT allocates it, with
+        # the array holding it.
+        def infer():
+            input_data = np.arange(5, dtype=np.float32).reshape((1, 5))
+            self._infer_fp32("mask_bucketed", input_data, input_data)
+
+        self._check_allocations("mask_bucketed", [infer], 2)
+
+    def test_batch_input(self):
+        # The batch input is kept, the input of the single request is
+        # wrapped in place.
+        def infer(batch_size):
+            input_data = np.arange(batch_size * 4, dtype=np.float32).reshape(
+                (batch_size, 4)
+            )
+            self._infer_fp32(
+                "add_element_count", input_data, input_data + batch_size * 4
+            )
+
+        self._check_allocations(
+            "add_element_count", [lambda: infer(1), lambda: infer(2)], 1
+        )
+
+
+if __name__ == "__main__":
+    unittest.main()